@@ -115,6 +115,22 @@ void bwrite(struct buf *b)
   virtio_disk_rw(b, 1);
 }
 
+// Write b's contents to disk, where b is not a cache
+// buffer but a private copy owned by the caller. The log
+// uses this to write a frozen copy of a block whose cached
+// copy may have changed since.
+void bwrite_uncached(struct buf *b)
+{
+  virtio_disk_rw(b, 1);
+}
+
+// Write n private copies, as for bwrite_uncached(), as one
+// batch. The disk may complete them in any order.
+void bwritev_uncached(struct buf **bs, int n)
+{
+  virtio_disk_rwv(bs, n, 1);
+}
+
 // Release a locked buffer.
 // Move to the head of the most-recently-used list.
 void brelse(struct buf *b)
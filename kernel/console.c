@@ -1,12 +1,17 @@
 //
 // Console input and output, to the uart.
-// Reads are line at a time.
-// Implements special input characters:
+// In cooked mode, the default, reads are line at a time,
+// and input is echoed and edited here, with these special
+// input characters:
 //   newline -- end of line
 //   control-h -- backspace
 //   control-u -- kill line
 //   control-d -- end of file
 //   control-p -- print process list
+// In raw mode, which the shell's line editor sets with
+// ioctl(), each character is passed on as typed, without
+// echo, and only control-p is special; a read still ends
+// at a newline.
 //
 
 #include <stdarg.h>
@@ -21,6 +26,7 @@
 #include "riscv.h"
 #include "defs.h"
 #include "proc.h"
+#include "fcntl.h"
 
 #define BACKSPACE 0x100
 #define C(x) ((x) - '@') // Control-x
@@ -55,6 +61,9 @@ struct
   uint r; // Read index
   uint w; // Write index
   uint e; // Edit index
+
+  int mode; // CONS_COOKED or CONS_RAW
+  int wake; // w has moved since consolewake()
 } cons;
 
 //
@@ -75,13 +84,22 @@ int consolewrite(int user_src, uint64 src, int n)
   return i;
 }
 
+// tell epoll items watching the console whether input
+// is waiting. the caller holds cons.lock.
+static void
+consnotify(void)
+{
+  epollwakeup(&devsw[CONSOLE].watch, cons.r != cons.w ? POLLIN : 0, POLLOUT);
+}
+
 //
 // user read()s from the console go here.
-// copy (up to) a whole input line to dst.
-// user_dist indicates whether dst is a user
-// or kernel address.
+// copy (up to) a whole input line to dst, or in raw
+// mode what has been typed of it. user_dist indicates whether dst is a user
+// or kernel address. if nonblock, return what
+// has arrived, or -EAGAIN, instead of waiting.
 //
-int consoleread(int user_dst, uint64 dst, int n)
+int consoleread(int user_dst, uint64 dst, int n, int nonblock)
 {
   uint target;
   int c;
@@ -91,6 +109,9 @@ int consoleread(int user_dst, uint64 dst, int n)
   acquire(&cons.lock);
   while (n > 0)
   {
+    // return what there is, rather than wait for more.
+    if (cons.r == cons.w && n < target)
+      break;
     // wait until interrupt handler has put some
     // input into cons.buffer.
     while (cons.r == cons.w)
@@ -100,12 +121,17 @@ int consoleread(int user_dst, uint64 dst, int n)
         release(&cons.lock);
         return -1;
       }
+      if (nonblock)
+      {
+        release(&cons.lock);
+        return -EAGAIN;
+      }
       sleep(&cons.r, &cons.lock);
     }
 
     c = cons.buf[cons.r++ % INPUT_BUF_SIZE];
 
-    if (c == C('D'))
+    if (c == C('D') && cons.mode == CONS_COOKED)
     { // end-of-file
       if (n < target)
       {
@@ -126,108 +152,141 @@ int consoleread(int user_dst, uint64 dst, int n)
 
     if (c == '\n')
     {
-      // a whole line has arrived, return to
-      // the user-level read().
+      // a whole line has arrived, return to the
+      // user-level read(). in raw mode too, so that
+      // what follows is left for whoever reads next.
       break;
     }
   }
+  consnotify();
   release(&cons.lock);
 
   return target - n;
 }
 
-//
-// the console input interrupt handler.
-// uartintr() calls this for input character.
-// do erase/kill processing, append to cons.buf,
-// wake up consoleread() if a whole line has arrived.
-//
-// void consoleintr(int c)
-// {
-//   acquire(&cons.lock);
-
-//   switch (c)
-//   {
-//   case C('P'): // Print process list.
-//     procdump();
-//     break;
-//   case C('U'): // Kill line.
-//     while (cons.e != cons.w &&
-//            cons.buf[(cons.e - 1) % INPUT_BUF_SIZE] != '\n')
-//     {
-//       cons.e--;
-//       consputc(BACKSPACE);
-//     }
-//     break;
-//   case C('H'): // Backspace
-//   case '\x7f': // Delete key
-//     if (cons.e != cons.w)
-//     {
-//       cons.e--;
-//       consputc(BACKSPACE);
-//     }
-//     break;
-//   default:
-//     if (c != 0 && cons.e - cons.r < INPUT_BUF_SIZE)
-//     {
-//       c = (c == '\r') ? '\n' : c;
-
-//       // echo back to the user.
-//       consputc(c);
-
-//       // store for consumption by consoleread().
-//       cons.buf[cons.e++ % INPUT_BUF_SIZE] = c;
-
-//       if (c == '\n' || c == C('D') || cons.e - cons.r == INPUT_BUF_SIZE)
-//       {
-//         // wake up consoleread() if a whole line (or end-of-file)
-//         // has arrived.
-//         cons.w = cons.e;
-//         wakeup(&cons.r);
-//       }
-//     }
-//     break;
-//   }
-
-//   release(&cons.lock);
-// }
+// append c to cons.buf, echoing it in cooked mode, and
+// make it readable if it ends a line, or in raw mode.
+static void
+consstore(int c)
+{
+  if (c == 0 || cons.e - cons.r >= INPUT_BUF_SIZE)
+    return;
+  c = (c == '\r') ? '\n' : c;
+
+  if (cons.mode == CONS_COOKED)
+    consputc(c); // echo back to the user.
+
+  // store for consumption by consoleread().
+  cons.buf[cons.e++ % INPUT_BUF_SIZE] = c;
 
+  if (cons.mode == CONS_RAW || c == '\n' || c == C('D') ||
+      cons.e - cons.r == INPUT_BUF_SIZE)
+  {
+    cons.w = cons.e;
+    cons.wake = 1;
+  }
+}
+
+//
 // the console input interrupt handler.
-// uartintr() calls this for input character.
-// do erase/kill processing, append to cons.buf,
-// wake up consoleread() if a whole line has arrived.
+// uartintr() calls this for each input character.
+// do erase/kill processing, append to cons.buf, and
+// note if a whole line (or in raw mode, anything) has
+// arrived. uartintr() then calls consolewake(), so that
+// a burst of input, like a paste, wakes the reader once.
 //
 void consoleintr(int c)
 {
   acquire(&cons.lock);
 
+  if (cons.mode == CONS_RAW && c != C('P'))
+  {
+    consstore(c);
+    release(&cons.lock);
+    return;
+  }
+
   switch (c)
   {
   case C('P'): // Print process list.
     procdump();
     break;
-
-    // We no longer handle C('U') (kill line) and C('H') (backspace) in the kernel.
-    // These characters will now be passed directly to the user-space shell.
-
-  default:
-    if (c != 0 && cons.e - cons.r < INPUT_BUF_SIZE)
+  case C('U'): // Kill line.
+    while (cons.e != cons.w &&
+           cons.buf[(cons.e - 1) % INPUT_BUF_SIZE] != '\n')
     {
-      c = (c == '\r') ? '\n' : c; // Still convert carriage return to newline.
+      cons.e--;
+      consputc(BACKSPACE);
+    }
+    break;
+  case C('H'): // Backspace
+  case '\x7f': // Delete key
+    if (cons.e != cons.w)
+    {
+      cons.e--;
+      consputc(BACKSPACE);
+    }
+    break;
+  default:
+    consstore(c);
+    break;
+  }
 
-      // THE KERNEL NO LONGER ECHOES THE CHARACTER.
-      // consputc(c); // This line is commented out or removed.
+  release(&cons.lock);
+}
+
+// uartintr() has passed on all the input there was.
+// wake up consoleread(), and poll() and epoll, if
+// consoleintr() has made input available.
+void consolewake(void)
+{
+  acquire(&cons.lock);
+  if (cons.wake)
+  {
+    cons.wake = 0;
+    wakeup(&cons.r);
+    pollwakeup();
+    consnotify();
+  }
+  release(&cons.lock);
+}
 
-      cons.buf[cons.e++ % INPUT_BUF_SIZE] = c;
+// ioctl()s on the console: get or set the input mode.
+int consoleioctl(int req, int arg)
+{
+  int r = 0;
 
-      // Wake up consoleread() on EVERY character, not just on a newline.
+  acquire(&cons.lock);
+  if (req == CIOCGMODE)
+    r = cons.mode;
+  else if (req == CIOCSMODE && (arg == CONS_COOKED || arg == CONS_RAW))
+  {
+    cons.mode = arg;
+    if (arg == CONS_RAW && cons.w != cons.e)
+    {
+      // hand over a half-edited line as it is.
       cons.w = cons.e;
       wakeup(&cons.r);
+      pollwakeup();
+      consnotify();
     }
-    break;
   }
+  else
+    r = -1;
+  release(&cons.lock);
+  return r;
+}
 
+// poll() events ready on the console.
+int consolepoll(void)
+{
+  int r = POLLOUT;
+
+  acquire(&cons.lock);
+  if (cons.r != cons.w)
+    r |= POLLIN;
   release(&cons.lock);
+  return r;
 }
 
 void consoleinit(void)
@@ -240,4 +299,6 @@ void consoleinit(void)
   // to consoleread and consolewrite.
   devsw[CONSOLE].read = consoleread;
   devsw[CONSOLE].write = consolewrite;
+  devsw[CONSOLE].poll = consolepoll;
+  devsw[CONSOLE].ioctl = consoleioctl;
 }
@@ -0,0 +1,202 @@
+// Directory entry cache.
+//
+// Remembers the results of recent directory lookups, keyed by
+// (device, directory inode number, name), so that resolving a
+// path does not read directory blocks for every component. An
+// entry with inum 0 is negative: the directory is known not to
+// hold the name.
+//
+// Interface:
+// * dirlookup() asks dcache_lookup() first, and records what it
+//   found, or didn't, with dcache_enter().
+// * dirlink() and unlink must dcache_enter() the new state of
+//   the name; freeing a directory must dcache_purge() it.
+// * Callers hold the directory's lock, which orders lookups
+//   against changes to the same directory.
+
+#include "types.h"
+#include "param.h"
+#include "spinlock.h"
+#include "riscv.h"
+#include "defs.h"
+#include "fs.h"
+
+#define NDENTRY 256 // cached names
+#define NDHASH 61   // hash chains
+
+struct dentry
+{
+  uint dev;
+  uint dir; // directory's inum; 0 if the entry is unused
+  char name[DIRSIZ];
+  uint inum; // 0: name is not in dir
+  struct dentry *hnext; // hash chain
+  struct dentry *prev;  // LRU list
+  struct dentry *next;
+};
+
+struct
+{
+  struct spinlock lock;
+  struct dentry dentry[NDENTRY];
+  struct dentry *hash[NDHASH];
+
+  // Linked list of all entries, through prev/next.
+  // head.next is most recently used, head.prev is least.
+  struct dentry head;
+
+  uint64 hits;    // lookups answered with an inum
+  uint64 neghits; // lookups answered "not there"
+  uint64 misses;  // lookups that had to read the directory
+} dcache;
+
+void dcacheinit(void)
+{
+  struct dentry *e;
+
+  initlock(&dcache.lock, "dcache");
+  dcache.head.prev = &dcache.head;
+  dcache.head.next = &dcache.head;
+  for (e = dcache.dentry; e < dcache.dentry + NDENTRY; e++)
+  {
+    e->next = dcache.head.next;
+    e->prev = &dcache.head;
+    dcache.head.next->prev = e;
+    dcache.head.next = e;
+  }
+}
+
+static struct dentry **
+dchain(uint dev, uint dir, char *name)
+{
+  uint h = dev * 31 + dir;
+  int i;
+
+  for (i = 0; i < DIRSIZ && name[i]; i++)
+    h = h * 31 + (uchar)name[i];
+  return &dcache.hash[h % NDHASH];
+}
+
+// Find the entry for (dev, dir, name).
+// Caller must hold dcache.lock.
+static struct dentry *
+dfind(uint dev, uint dir, char *name)
+{
+  struct dentry *e;
+
+  for (e = *dchain(dev, dir, name); e; e = e->hnext)
+    if (e->dev == dev && e->dir == dir && namecmp(e->name, name) == 0)
+      return e;
+  return 0;
+}
+
+// Take e off its hash chain.
+static void
+dunhash(struct dentry *e)
+{
+  struct dentry **pp;
+
+  for (pp = dchain(e->dev, e->dir, e->name); *pp != e; pp = &(*pp)->hnext)
+    ;
+  *pp = e->hnext;
+  e->dir = 0;
+}
+
+// Move e to the front (most recent) or the back of the LRU list.
+static void
+dmove(struct dentry *e, int front)
+{
+  e->next->prev = e->prev;
+  e->prev->next = e->next;
+  if (front)
+  {
+    e->next = dcache.head.next;
+    e->prev = &dcache.head;
+  }
+  else
+  {
+    e->next = &dcache.head;
+    e->prev = dcache.head.prev;
+  }
+  e->next->prev = e;
+  e->prev->next = e;
+}
+
+// Is name in directory dir cached? If so, set *inum (0 if the
+// name is known to be absent) and return 1.
+int dcache_lookup(uint dev, uint dir, char *name, uint *inum)
+{
+  struct dentry *e;
+
+  acquire(&dcache.lock);
+  if ((e = dfind(dev, dir, name)) == 0)
+  {
+    dcache.misses++;
+    release(&dcache.lock);
+    return 0;
+  }
+  *inum = e->inum;
+  if (e->inum)
+    dcache.hits++;
+  else
+    dcache.neghits++;
+  dmove(e, 1);
+  release(&dcache.lock);
+  return 1;
+}
+
+// Record that name in directory dir is inum (0: absent),
+// recycling the least recently used entry if need be.
+void dcache_enter(uint dev, uint dir, char *name, uint inum)
+{
+  struct dentry *e, **pp;
+
+  acquire(&dcache.lock);
+  if ((e = dfind(dev, dir, name)) == 0)
+  {
+    e = dcache.head.prev;
+    if (e->dir)
+      dunhash(e);
+    e->dev = dev;
+    e->dir = dir;
+    strncpy(e->name, name, DIRSIZ);
+    pp = dchain(dev, dir, name);
+    e->hnext = *pp;
+    *pp = e;
+  }
+  e->inum = inum;
+  dmove(e, 1);
+  release(&dcache.lock);
+}
+
+// Forget every name in directory dir, which is being freed,
+// so that nothing is found in a new one that reuses its inum.
+void dcache_purge(uint dev, uint dir)
+{
+  struct dentry *e;
+
+  acquire(&dcache.lock);
+  for (e = dcache.dentry; e < dcache.dentry + NDENTRY; e++)
+  {
+    if (e->dir == dir && e->dev == dev)
+    {
+      dunhash(e);
+      dmove(e, 0);
+    }
+  }
+  release(&dcache.lock);
+}
+
+int dcache_stats(char *buf, int sz)
+{
+  uint64 total;
+  int n;
+
+  acquire(&dcache.lock);
+  total = dcache.hits + dcache.neghits + dcache.misses;
+  n = snprintf(buf, sz, "dcache: hits %lu negative %lu misses %lu (%d%% hit)\n",
+               dcache.hits, dcache.neghits, dcache.misses,
+               total ? (int)((dcache.hits + dcache.neghits) * 100 / total) : 0);
+  release(&dcache.lock);
+  return n;
+}
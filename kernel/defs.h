@@ -2,7 +2,12 @@ struct buf;
 struct context;
 struct file;
 struct inode;
+struct iovec;
+struct epitem;
+struct epoll_event;
+struct eventpoll;
 struct pipe;
+struct pollfd;
 struct proc;
 struct spinlock;
 struct sleeplock;
@@ -14,12 +19,15 @@ void binit(void);
 struct buf *bread(uint, uint);
 void brelse(struct buf *);
 void bwrite(struct buf *);
+void bwrite_uncached(struct buf *);
+void bwritev_uncached(struct buf **, int);
 void bpin(struct buf *);
 void bunpin(struct buf *);
 
 // console.c
 void consoleinit(void);
 void consoleintr(int);
+void consolewake(void);
 void consputc(int);
 
 // exec.c
@@ -30,15 +38,32 @@ struct file *filealloc(void);
 void fileclose(struct file *);
 struct file *filedup(struct file *);
 void fileinit(void);
-int fileread(struct file *, uint64, int n);
+int fileread(struct file *, int, uint64, int n);
 int filestat(struct file *, uint64 addr);
-int filewrite(struct file *, uint64, int n);
+int filewrite(struct file *, int, uint64, int n);
+int filereadv(struct file *, int, struct iovec *, int);
+int filewritev(struct file *, int, struct iovec *, int);
+int filepoll(struct file *);
+int fileioctl(struct file *, int, int);
+int filepread(struct file *, int, uint64, int, uint);
+int filepwrite(struct file *, int, uint64, int, uint);
+int fileseek(struct file *, int, int);
+int filesplice(struct file *, struct file *, int);
+int filesendfile(struct file *, struct file *, int, int);
+
+// dcache.c
+void dcacheinit(void);
+int dcache_lookup(uint, uint, char *, uint *);
+void dcache_enter(uint, uint, char *, uint);
+void dcache_purge(uint, uint);
+int dcache_stats(char *, int);
 
 // fs.c
 void fsinit(int);
 int dirlink(struct inode *, char *, uint);
+int dirread(struct inode *, int, uint64, int, uint *, int);
 struct inode *dirlookup(struct inode *, char *, uint *);
-struct inode *ialloc(uint, short);
+struct inode *ialloc(uint, short, uint);
 struct inode *idup(struct inode *);
 void iinit();
 void ilock(struct inode *);
@@ -53,6 +78,10 @@ int readi(struct inode *, int, uint64, uint, uint);
 void stati(struct inode *, struct stat *);
 int writei(struct inode *, int, uint64, uint, uint);
 void itrunc(struct inode *);
+void itruncop(struct inode *);
+uint ibmap(struct inode *, uint);
+void iblockmap(struct inode *);
+int icache_stats(char *, int);
 
 // ramdisk.c
 void ramdiskinit(void);
@@ -69,12 +98,39 @@ void initlog(int, struct superblock *);
 void log_write(struct buf *);
 void begin_op(void);
 void end_op(void);
+void begin_opn(int);
+void end_opn(int);
+int log_maxop(void);
+int log_stats(char *, int);
+void log_sync(void);
 
 // pipe.c
 int pipealloc(struct file **, struct file **);
 void pipeclose(struct pipe *, int);
-int piperead(struct pipe *, uint64, int);
-int pipewrite(struct pipe *, uint64, int);
+int pipereadv(struct pipe *, int, struct iovec *, int, int);
+int pipewritev(struct pipe *, int, struct iovec *, int, int);
+int pipepoll(struct pipe *, int);
+struct epitem **pipewatch(struct pipe *);
+int pipegetsize(struct pipe *);
+int pipespace(struct pipe *);
+int pipesetsize(struct pipe *, int);
+
+// poll.c
+void pollinit(void);
+void pollwakeup(void);
+void polltick(void);
+int poll(struct pollfd *, int, int);
+
+// epoll.c
+void epollinit(void);
+void epollwakeup(struct epitem **, int, int);
+void epolltick(void);
+struct eventpoll *epollalloc(void);
+void epollclose(struct eventpoll *);
+void epollrelease(struct file *);
+int epollctl(struct eventpoll *, int, struct file *, struct epoll_event *);
+int epollwait(struct eventpoll *, struct epoll_event *, int, int);
+int epollpoll(struct eventpoll *);
 
 // printf.c
 int printf(char *, ...) __attribute__((format(printf, 1, 2)));
@@ -90,6 +146,7 @@ void proc_mapstacks(pagetable_t);
 pagetable_t proc_pagetable(struct proc *);
 void proc_freepagetable(pagetable_t, uint64);
 int kill(int);
+void kthread(void (*)(void), char *);
 int killed(struct proc *);
 void setkilled(struct proc *);
 struct cpu *mycpu(void);
@@ -110,6 +167,9 @@ void procdump(void);
 // swtch.S
 void swtch(struct context *, struct context *);
 
+// sprintf.c
+int snprintf(char *, int, char *, ...) __attribute__((format(printf, 3, 4)));
+
 // spinlock.c
 void acquire(struct spinlock *);
 int holding(struct spinlock *);
@@ -124,6 +184,9 @@ void releasesleep(struct sleeplock *);
 int holdingsleep(struct sleeplock *);
 void initsleeplock(struct sleeplock *, char *);
 
+// stats.c
+void statsinit(void);
+
 // string.c
 int memcmp(const void *, const void *, uint);
 void *memmove(void *, const void *, uint);
@@ -183,7 +246,9 @@ void plic_complete(int);
 // virtio_disk.c
 void virtio_disk_init(void);
 void virtio_disk_rw(struct buf *, int);
+void virtio_disk_rwv(struct buf **, int, int);
 void virtio_disk_intr(void);
+int virtio_disk_stats(char *, int);
 
 // number of elements in fixed-size array
 #define NELEM(x) (sizeof(x) / sizeof((x)[0]))
@@ -0,0 +1,415 @@
+//
+// Event queues for processes that watch many files: epoll.
+//
+// poll() checks every file it is given, on every call. An
+// epoll instance instead keeps an item for each file it
+// watches, linked on that pipe's or device's watch list.
+// Whenever the pipe or device changes, it calls epollwakeup()
+// with its new state, which is recorded in each item on the
+// list; items that became ready go on their instance's ready
+// list. epoll_wait() looks only at the ready list, so what it
+// costs depends on how many files are ready, not on how many
+// are watched.
+//
+// A level-triggered item stays on the ready list for as long
+// as its file is ready. An edge-triggered one (EPOLLET) is
+// reported once for each change, and then leaves the list.
+//
+
+#include "types.h"
+#include "param.h"
+#include "spinlock.h"
+#include "riscv.h"
+#include "defs.h"
+#include "proc.h"
+#include "fs.h"
+#include "sleeplock.h"
+#include "file.h"
+#include "fcntl.h"
+
+struct epitem
+{
+  struct eventpoll *ep;  // owner; 0 if the item is free
+  struct file *f;        // the watched file
+  struct epitem **watch; // the watch list the item is on
+  struct epitem *wnext;  // next on that watch list
+  struct epitem *rnext;  // next on ep's ready list
+  int ready;             // on ep's ready list
+  int seen;              // epollwakeup() has set revents
+  int revents;           // the file's events, from epollwakeup()
+  uint events;           // what to report, and EPOLLET
+  uint64 data;           // returned with the events
+};
+
+struct eventpoll
+{
+  int used;
+  struct epitem *ready; // ready list, oldest first
+  struct epitem *rtail;
+  int nwait;  // processes in epoll_wait()
+  int ntimed; // how many of them have a timeout
+};
+
+struct
+{
+  struct spinlock lock; // protects everything in epoll.c
+  struct eventpoll ep[NEPOLL];
+  struct epitem item[NEPITEM];
+  int ntimed; // epoll_wait()s with a timeout, on any instance
+} epq;
+
+void epollinit(void)
+{
+  initlock(&epq.lock, "epoll");
+}
+
+// the watch list for f, or 0 if f can't be watched.
+static struct epitem **
+watchlist(struct file *f)
+{
+  if (f->type == FD_PIPE)
+    return pipewatch(f->pipe);
+  if (f->type == FD_DEVICE && f->major >= 0 && f->major < NDEV && devsw[f->major].poll)
+    return &devsw[f->major].watch;
+  return 0;
+}
+
+// put it at the end of its instance's ready list.
+static void
+epready(struct epitem *it)
+{
+  struct eventpoll *ep = it->ep;
+
+  if (it->ready)
+    return;
+  it->ready = 1;
+  it->rnext = 0;
+  if (ep->rtail)
+    ep->rtail->rnext = it;
+  else
+    ep->ready = it;
+  ep->rtail = it;
+}
+
+// take it off the lists it is on, and free it.
+static void
+epfree(struct epitem *it)
+{
+  struct eventpoll *ep = it->ep;
+  struct epitem **pp, *prev;
+
+  for (pp = it->watch; *pp != it; pp = &(*pp)->wnext)
+    ;
+  *pp = it->wnext;
+  if (it->ready)
+  {
+    prev = 0;
+    for (pp = &ep->ready; *pp != it; pp = &(*pp)->rnext)
+      prev = *pp;
+    *pp = it->rnext;
+    if (ep->rtail == it)
+      ep->rtail = prev;
+  }
+  it->ep = 0;
+}
+
+// the part of its file's state that it reports.
+static int
+epmask(struct epitem *it)
+{
+  return it->revents & (it->events | POLLERR | POLLHUP);
+}
+
+// A pipe or device has changed. watch is its watch list;
+// rmask is what is now ready for reading it, and wmask for
+// writing it. The caller holds the pipe's or device's lock,
+// so calls for one file are in order. When nothing watches
+// the file, this costs one load.
+void epollwakeup(struct epitem **watch, int rmask, int wmask)
+{
+  struct epitem *it;
+  int ready = 0;
+
+  if (*watch == 0)
+    return;
+  acquire(&epq.lock);
+  for (it = *watch; it; it = it->wnext)
+  {
+    it->revents = (it->f->readable ? rmask : 0) | (it->f->writable ? wmask : 0);
+    it->seen = 1;
+    if (epmask(it))
+    {
+      epready(it);
+      if (it->ep->nwait)
+        wakeup(it->ep);
+      ready = 1;
+    }
+  }
+  if (ready)
+    pollwakeup(); // for poll()s of the epoll instances
+  release(&epq.lock);
+}
+
+// Called on each clock tick, to let timeouts expire.
+void epolltick(void)
+{
+  struct eventpoll *ep;
+
+  if (epq.ntimed == 0)
+    return;
+  acquire(&epq.lock);
+  for (ep = epq.ep; ep < epq.ep + NEPOLL; ep++)
+  {
+    if (ep->ntimed)
+      wakeup(ep);
+  }
+  release(&epq.lock);
+}
+
+struct eventpoll *
+epollalloc(void)
+{
+  struct eventpoll *ep;
+
+  acquire(&epq.lock);
+  for (ep = epq.ep; ep < epq.ep + NEPOLL; ep++)
+  {
+    if (ep->used == 0)
+    {
+      ep->used = 1;
+      ep->ready = ep->rtail = 0;
+      release(&epq.lock);
+      return ep;
+    }
+  }
+  release(&epq.lock);
+  return 0;
+}
+
+// The last reference to ep's file is gone.
+void epollclose(struct eventpoll *ep)
+{
+  struct epitem *it;
+
+  acquire(&epq.lock);
+  for (it = epq.item; it < epq.item + NEPITEM; it++)
+  {
+    if (it->ep == ep)
+      epfree(it);
+  }
+  ep->used = 0;
+  release(&epq.lock);
+}
+
+// The last reference to f is gone; stop watching it.
+// Called from fileclose(), while f is still intact.
+void epollrelease(struct file *f)
+{
+  struct epitem **watch, *it, *next;
+
+  if ((watch = watchlist(f)) == 0 || *watch == 0)
+    return;
+  acquire(&epq.lock);
+  for (it = *watch; it; it = next)
+  {
+    next = it->wnext;
+    if (it->f == f)
+      epfree(it);
+  }
+  release(&epq.lock);
+}
+
+static struct epitem *
+epfind(struct eventpoll *ep, struct file *f)
+{
+  struct epitem *it;
+
+  for (it = epq.item; it < epq.item + NEPITEM; it++)
+  {
+    if (it->ep == ep && it->f == f)
+      return it;
+  }
+  return 0;
+}
+
+// Add, change or remove (op) ep's item for file f. ev
+// gives the events to watch for, and the data to return.
+int epollctl(struct eventpoll *ep, int op, struct file *f, struct epoll_event *ev)
+{
+  struct epitem **watch, *it;
+  int r;
+
+  if ((watch = watchlist(f)) == 0)
+    return -1;
+  acquire(&epq.lock);
+  it = epfind(ep, f);
+  if (op == EPOLL_CTL_DEL)
+  {
+    if (it)
+      epfree(it);
+    release(&epq.lock);
+    return it ? 0 : -1;
+  }
+  if (op == EPOLL_CTL_MOD)
+  {
+    if (it == 0)
+    {
+      release(&epq.lock);
+      return -1;
+    }
+    it->events = ev->events;
+    it->data = ev->data;
+    if (it->seen && epmask(it))
+    {
+      epready(it);
+      wakeup(ep);
+      pollwakeup();
+    }
+    release(&epq.lock);
+    return 0;
+  }
+  if (op != EPOLL_CTL_ADD || it)
+  {
+    release(&epq.lock);
+    return -1;
+  }
+  for (it = epq.item; it < epq.item + NEPITEM && it->ep; it++)
+    ;
+  if (it == epq.item + NEPITEM)
+  {
+    release(&epq.lock);
+    return -1;
+  }
+  it->ep = ep;
+  it->f = f;
+  it->events = ev->events;
+  it->data = ev->data;
+  it->ready = 0;
+  it->seen = 0;
+  it->revents = 0;
+  it->watch = watch;
+  it->wnext = *watch;
+  *watch = it;
+  release(&epq.lock);
+
+  // find out the file's state now. filepoll() takes the pipe's
+  // or device's lock, which comes before epq.lock, so it can't
+  // be called above. if epollwakeup() has reported since the
+  // item was linked in, what it saw is at least as new.
+  r = filepoll(f);
+  acquire(&epq.lock);
+  if (it->ep == ep && it->f == f && !it->seen)
+  {
+    it->revents = r;
+    it->seen = 1;
+    if (epmask(it))
+    {
+      epready(it);
+      wakeup(ep);
+      pollwakeup();
+    }
+  }
+  release(&epq.lock);
+  return 0;
+}
+
+// poll() events ready on ep itself: POLLIN if a file it
+// watches is ready, so that epoll_wait() would not wait.
+// epoll instances can't watch each other, but poll() can
+// watch them.
+int epollpoll(struct eventpoll *ep)
+{
+  struct epitem *it;
+  int r = 0;
+
+  acquire(&epq.lock);
+  for (it = ep->ready; it; it = it->rnext)
+  {
+    if (epmask(it))
+    {
+      r = POLLIN;
+      break;
+    }
+  }
+  release(&epq.lock);
+  return r;
+}
+
+// Move up to max ready items of ep to ev, and return how many.
+static int
+epscan(struct eventpoll *ep, struct epoll_event *ev, int max)
+{
+  struct epitem *it, *again, *atail;
+  int n = 0;
+
+  again = atail = 0;
+  while ((it = ep->ready) != 0 && n < max)
+  {
+    ep->ready = it->rnext;
+    if (ep->ready == 0)
+      ep->rtail = 0;
+    it->ready = 0;
+    if (epmask(it) == 0)
+      continue; // no longer ready
+    ev[n].events = epmask(it);
+    ev[n].data = it->data;
+    n++;
+    if (it->events & EPOLLET)
+      continue;
+    it->rnext = 0;
+    if (atail)
+      atail->rnext = it;
+    else
+      again = it;
+    atail = it;
+  }
+  // level-triggered items go back at the end, behind any
+  // that were not reported, to be looked at again next time.
+  while ((it = again) != 0)
+  {
+    again = it->rnext;
+    epready(it);
+  }
+  return n;
+}
+
+// Wait until some of ep's files are ready, or timeout ticks
+// pass (forever if timeout < 0). Fills in up to max entries
+// of ev, and returns how many, 0 on timeout, or -1.
+int epollwait(struct eventpoll *ep, struct epoll_event *ev, int max, int timeout)
+{
+  uint t0;
+  int n;
+
+  acquire(&tickslock);
+  t0 = ticks;
+  release(&tickslock);
+
+  acquire(&epq.lock);
+  ep->nwait++;
+  if (timeout > 0)
+  {
+    ep->ntimed++;
+    epq.ntimed++;
+  }
+  for (;;)
+  {
+    n = epscan(ep, ev, max);
+    if (n || timeout == 0 || (timeout > 0 && ticks - t0 >= timeout))
+      break;
+    if (killed(myproc()))
+    {
+      n = -1;
+      break;
+    }
+    sleep(ep, &epq.lock);
+  }
+  ep->nwait--;
+  if (timeout > 0)
+  {
+    ep->ntimed--;
+    epq.ntimed--;
+  }
+  release(&epq.lock);
+  return n;
+}
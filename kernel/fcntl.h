@@ -3,3 +3,70 @@
 #define O_RDWR 0x002
 #define O_CREATE 0x200
 #define O_TRUNC 0x400
+#define O_BLOCKMAP 0x800 // create a block-mapped, not extent-mapped, file
+#define O_NONBLOCK 0x1000 // reads and writes return -EAGAIN rather than wait
+
+// returned, negated, by a read or write of an O_NONBLOCK
+// file that would otherwise have had to wait.
+#define EAGAIN 11
+
+// lseek() whence
+#define SEEK_SET 0 // from the start of the file
+#define SEEK_CUR 1 // from the current offset
+#define SEEK_END 2 // from the end of the file
+
+// getdents() flags
+#define GD_STAT 0x1 // fill in each entry's type, nlink and size
+
+// a file for poll() to watch
+struct pollfd
+{
+  int fd;        // ignored if negative
+  short events;  // what to wait for
+  short revents; // what poll() found
+};
+
+// poll() events
+#define POLLIN 0x01   // there is data to read
+#define POLLOUT 0x04  // there is room to write
+#define POLLERR 0x08  // writing would fail (always reported)
+#define POLLHUP 0x10  // the writer has gone (always reported)
+#define POLLNVAL 0x20 // fd is not open (always reported)
+
+// what epoll_ctl() registers, and epoll_wait() returns
+struct epoll_event
+{
+  uint events; // poll() events, and EPOLLET
+  uint64 data; // the caller's, returned with the events
+};
+
+// epoll events are poll()'s, plus
+#define EPOLLET 0x80000000 // report each change once, not while ready
+
+// epoll_ctl() operations
+#define EPOLL_CTL_ADD 1 // watch a file
+#define EPOLL_CTL_DEL 2 // stop watching it
+#define EPOLL_CTL_MOD 3 // change its events or data
+
+// a buffer for readv() and writev()
+struct iovec
+{
+  void *iov_base;
+  uint64 iov_len;
+};
+
+#define IOV_MAX 16 // most buffers in one readv() or writev()
+
+// fcntl() commands
+#define F_GETPIPE_SZ 1 // size of a pipe's buffer
+#define F_SETPIPE_SZ 2 // resize a pipe's buffer; returns the new size
+#define F_GETFL 3      // the file's access mode and O_NONBLOCK
+#define F_SETFL 4      // set the file's O_NONBLOCK
+
+// ioctl() requests for the console
+#define CIOCGMODE 1 // get the input mode
+#define CIOCSMODE 2 // set the input mode
+
+// console input modes
+#define CONS_COOKED 0 // a line at a time, echoed and edited by the kernel
+#define CONS_RAW 1    // each character as typed, without echo
@@ -12,6 +12,7 @@
 #include "file.h"
 #include "stat.h"
 #include "proc.h"
+#include "fcntl.h"
 
 struct devsw devsw[NDEV];
 struct
@@ -37,6 +38,7 @@ filealloc(void)
     if (f->ref == 0)
     {
       f->ref = 1;
+      f->nonblock = 0;
       release(&ftable.lock);
       return f;
     }
@@ -70,6 +72,7 @@ void fileclose(struct file *f)
     release(&ftable.lock);
     return;
   }
+  epollrelease(f);
   ff = *f;
   f->ref = 0;
   f->type = FD_NONE;
@@ -85,6 +88,10 @@ void fileclose(struct file *f)
     iput(ff.ip);
     end_op();
   }
+  else if (ff.type == FD_EPOLL)
+  {
+    epollclose(ff.ep);
+  }
 }
 
 // Get metadata about file f.
@@ -106,30 +113,70 @@ int filestat(struct file *f, uint64 addr)
   return -1;
 }
 
-// Read from file f.
-// addr is a user virtual address.
-int fileread(struct file *f, uint64 addr, int n)
+// Total length of the cnt buffers of iov.
+static int
+iovlen(struct iovec *iov, int cnt)
+{
+  int i, n = 0;
+
+  for (i = 0; i < cnt; i++)
+    n += iov[i].iov_len;
+  return n;
+}
+
+// Read from file f into the cnt buffers of iov, in order.
+// The buffers are at user virtual addresses if user_dst
+// is 1, and kernel addresses otherwise.
+int filereadv(struct file *f, int user_dst, struct iovec *iov, int cnt)
 {
-  int r = 0;
+  int r = 0, i, m, n, off;
+  char *page;
 
   if (f->readable == 0)
     return -1;
 
   if (f->type == FD_PIPE)
   {
-    r = piperead(f->pipe, addr, n);
+    r = pipereadv(f->pipe, user_dst, iov, cnt, f->nonblock);
   }
   else if (f->type == FD_DEVICE)
   {
     if (f->major < 0 || f->major >= NDEV || !devsw[f->major].read)
       return -1;
-    r = devsw[f->major].read(1, addr, n);
+    if (cnt == 1)
+      return devsw[f->major].read(user_dst, (uint64)iov[0].iov_base, iov[0].iov_len, f->nonblock);
+    // read once, into a page, then hand it out to the buffers.
+    if ((page = kalloc()) == 0)
+      return -1;
+    n = iovlen(iov, cnt);
+    r = devsw[f->major].read(0, (uint64)page, n < PGSIZE ? n : PGSIZE, f->nonblock);
+    for (i = 0, off = 0; i < cnt && off < r; i++, off += m)
+    {
+      m = iov[i].iov_len < r - off ? iov[i].iov_len : r - off;
+      if (either_copyout(user_dst, (uint64)iov[i].iov_base, page + off, m) == -1)
+      {
+        r = -1;
+        break;
+      }
+    }
+    kfree(page);
   }
   else if (f->type == FD_INODE)
   {
     ilock(f->ip);
-    if ((r = readi(f->ip, 1, addr, f->off, n)) > 0)
-      f->off += r;
+    for (i = 0; i < cnt; i++)
+    {
+      if ((m = readi(f->ip, user_dst, (uint64)iov[i].iov_base, f->off, iov[i].iov_len)) < 0)
+      {
+        if (r == 0)
+          r = -1;
+        break;
+      }
+      f->off += m;
+      r += m;
+      if (m < iov[i].iov_len)
+        break;
+    }
     iunlock(f->ip);
   }
   else
@@ -140,56 +187,128 @@ int fileread(struct file *f, uint64 addr, int n)
   return r;
 }
 
-// Write to file f.
-// addr is a user virtual address.
-int filewrite(struct file *f, uint64 addr, int n)
+// Read n bytes from file f.
+// addr is a user virtual address if user_dst is 1,
+// and a kernel address otherwise.
+int fileread(struct file *f, int user_dst, uint64 addr, int n)
+{
+  struct iovec iov;
+
+  iov.iov_base = (void *)addr;
+  iov.iov_len = n;
+  return filereadv(f, user_dst, &iov, 1);
+}
+
+// Write the cnt buffers of iov to inode ip at *off, advancing *off.
+static int
+inodewritev(struct inode *ip, int user_src, struct iovec *iov, int cnt, uint *off)
 {
-  int r, ret = 0;
+  int r = 0, k = 0;
+  uint j = 0, m;
+
+  // write a chunk of blocks at a time to avoid exceeding
+  // the maximum log transaction size, including
+  // i-node, indirect block, allocation blocks,
+  // and 2 blocks of slop for non-aligned writes.
+  // each chunk reserves log space in proportion to
+  // its size, so big writes take few transactions,
+  // and a writev() that fits in one is a single one.
+  // this really belongs lower down, since writei()
+  // might be writing a device like the console.
+  int max = ((log_maxop() - 1 - 1 - 2) / 2) * BSIZE;
+  int n = iovlen(iov, cnt);
+  int i = 0;
+  while (i < n)
+  {
+    int n1 = n - i;
+    if (n1 > max)
+      n1 = max;
+    int nblocks = 2 * ((n1 + BSIZE - 1) / BSIZE) + 1 + 1 + 2;
+
+    begin_opn(nblocks);
+    ilock(ip);
+    // n1 bytes, from as many of the buffers as it takes.
+    for (r = 0; r < n1; r += m)
+    {
+      while (j == iov[k].iov_len)
+      {
+        k++;
+        j = 0;
+      }
+      m = iov[k].iov_len - j < n1 - r ? iov[k].iov_len - j : n1 - r;
+      if (writei(ip, user_src, (uint64)iov[k].iov_base + j, *off, m) != m)
+        break;
+      *off += m;
+      j += m;
+    }
+    iunlock(ip);
+    end_opn(nblocks);
+
+    if (r != n1)
+    {
+      // error from writei
+      break;
+    }
+    i += r;
+  }
+  return i == n ? n : -1;
+}
+
+// Write the cnt buffers of iov to file f, in order.
+// The buffers are at user virtual addresses if user_src
+// is 1, and kernel addresses otherwise.
+int filewritev(struct file *f, int user_src, struct iovec *iov, int cnt)
+{
+  int ret = 0, k = 0, r, m, n;
+  uint j = 0;
+  char *page;
 
   if (f->writable == 0)
     return -1;
 
   if (f->type == FD_PIPE)
   {
-    ret = pipewrite(f->pipe, addr, n);
+    ret = pipewritev(f->pipe, user_src, iov, cnt, f->nonblock);
   }
   else if (f->type == FD_DEVICE)
   {
     if (f->major < 0 || f->major >= NDEV || !devsw[f->major].write)
       return -1;
-    ret = devsw[f->major].write(1, addr, n);
-  }
-  else if (f->type == FD_INODE)
-  {
-    // write a few blocks at a time to avoid exceeding
-    // the maximum log transaction size, including
-    // i-node, indirect block, allocation blocks,
-    // and 2 blocks of slop for non-aligned writes.
-    // this really belongs lower down, since writei()
-    // might be writing a device like the console.
-    int max = ((MAXOPBLOCKS - 1 - 1 - 2) / 2) * BSIZE;
-    int i = 0;
-    while (i < n)
+    if (cnt == 1)
+      return devsw[f->major].write(user_src, (uint64)iov[0].iov_base, iov[0].iov_len);
+    // gather the buffers into a page, and write each
+    // pageful with one call.
+    if ((page = kalloc()) == 0)
+      return -1;
+    n = iovlen(iov, cnt);
+    while (ret < n)
     {
-      int n1 = n - i;
-      if (n1 > max)
-        n1 = max;
-
-      begin_op();
-      ilock(f->ip);
-      if ((r = writei(f->ip, 1, addr + i, f->off, n1)) > 0)
-        f->off += r;
-      iunlock(f->ip);
-      end_op();
-
-      if (r != n1)
+      for (m = 0; m < PGSIZE && ret + m < n; m += r)
       {
-        // error from writei
-        break;
+        while (j == iov[k].iov_len)
+        {
+          k++;
+          j = 0;
+        }
+        r = iov[k].iov_len - j < PGSIZE - m ? iov[k].iov_len - j : PGSIZE - m;
+        if (either_copyin(page + m, user_src, (uint64)iov[k].iov_base + j, r) == -1)
+        {
+          // write what there is, and stop.
+          n = ret + m;
+          break;
+        }
+        j += r;
       }
-      i += r;
+      if ((r = devsw[f->major].write(0, (uint64)page, m)) > 0)
+        ret += r;
+      if (r != m)
+        break;
     }
-    ret = (i == n ? n : -1);
+    kfree(page);
+  }
+  else if (f->type == FD_INODE)
+  {
+    ret = inodewritev(f->ip, user_src, iov, cnt, &f->off);
   }
   else
   {
@@ -198,3 +317,199 @@ int filewrite(struct file *f, uint64 addr, int n)
 
   return ret;
 }
+
+// Write n bytes to file f.
+// addr is a user virtual address if user_src is 1,
+// and a kernel address otherwise.
+int filewrite(struct file *f, int user_src, uint64 addr, int n)
+{
+  struct iovec iov;
+
+  iov.iov_base = (void *)addr;
+  iov.iov_len = n;
+  return filewritev(f, user_src, &iov, 1);
+}
+
+// poll() events ready on file f.
+int filepoll(struct file *f)
+{
+  int r = (f->readable ? POLLIN : 0) | (f->writable ? POLLOUT : 0);
+
+  if (f->type == FD_PIPE)
+    return pipepoll(f->pipe, f->writable);
+  if (f->type == FD_EPOLL)
+    return epollpoll(f->ep);
+  if (f->type == FD_DEVICE && f->major >= 0 && f->major < NDEV && devsw[f->major].poll)
+    return devsw[f->major].poll() & r;
+  // inodes, and devices that can't say, never make you wait.
+  return r;
+}
+
+// A device-specific request, for f's device to carry out.
+int fileioctl(struct file *f, int req, int arg)
+{
+  if (f->type != FD_DEVICE || f->major < 0 || f->major >= NDEV || !devsw[f->major].ioctl)
+    return -1;
+  return devsw[f->major].ioctl(req, arg);
+}
+
+// Read from inode file f at offset off, without using or
+// changing f's own offset, so that processes sharing f
+// don't have to agree on it.
+int filepread(struct file *f, int user_dst, uint64 addr, int n, uint off)
+{
+  int r;
+
+  if (f->readable == 0 || f->type != FD_INODE)
+    return -1;
+  ilock(f->ip);
+  r = readi(f->ip, user_dst, addr, off, n);
+  iunlock(f->ip);
+  return r;
+}
+
+// Write to inode file f at offset off, leaving f's offset alone.
+int filepwrite(struct file *f, int user_src, uint64 addr, int n, uint off)
+{
+  struct iovec iov;
+
+  if (f->writable == 0 || f->type != FD_INODE)
+    return -1;
+  iov.iov_base = (void *)addr;
+  iov.iov_len = n;
+  return inodewritev(f->ip, user_src, &iov, 1, &off);
+}
+
+// Set inode file f's offset to off, relative to whence:
+// the start of the file, the current offset, or the end.
+// Returns the new offset, or -1.
+int fileseek(struct file *f, int off, int whence)
+{
+  int base;
+
+  if (f->type != FD_INODE)
+    return -1;
+  switch (whence)
+  {
+  case SEEK_SET:
+    base = 0;
+    break;
+  case SEEK_CUR:
+    base = f->off;
+    break;
+  case SEEK_END:
+    ilock(f->ip);
+    base = f->ip->size;
+    iunlock(f->ip);
+    break;
+  default:
+    return -1;
+  }
+  if (base + off < 0)
+    return -1;
+  f->off = base + off;
+  return f->off;
+}
+
+// Move up to n bytes from in to out inside the kernel, a page
+// at a time, instead of through a user buffer. Reads in at off,
+// or at in's own offset if off < 0. Like read(), stops early
+// once in gives less than was asked for: at the end of a file,
+// or when a pipe or the console has no more for now.
+// Returns the number of bytes moved, -EAGAIN if none could be
+// because an O_NONBLOCK in or out would have had to wait, or -1.
+//
+// Bytes read from in that out doesn't take must not be lost.
+// An inode's offset is moved back over them; a pipe or device
+// can't take them back, so for a non-blocking pipe out only as
+// much as it has room for is read.
+static int
+filecopy(struct file *in, int off, struct file *out, int n)
+{
+  struct iovec iov;
+  char *page;
+  int m, w, x, r = 0, total = 0;
+
+  if (in->readable == 0 || out->writable == 0 || n < 0)
+    return -1;
+  if ((page = kalloc()) == 0)
+    return -1;
+  while (total < n)
+  {
+    if (killed(myproc()))
+    {
+      r = -1;
+      break;
+    }
+    m = n - total < PGSIZE ? n - total : PGSIZE;
+    if (out->type == FD_PIPE && out->nonblock)
+    {
+      if ((x = pipespace(out->pipe)) == 0)
+      {
+        r = -EAGAIN;
+        break;
+      }
+      if (x < m)
+        m = x;
+    }
+    if (off < 0)
+      r = fileread(in, 0, (uint64)page, m);
+    else
+    {
+      ilock(in->ip);
+      r = readi(in->ip, 0, (uint64)page, off + total, m);
+      iunlock(in->ip);
+    }
+    if (r <= 0)
+      break;
+    w = filewrite(out, 0, (uint64)page, r);
+    if (w == -EAGAIN)
+      w = 0;
+    if (w >= 0 && w < r && off < 0 && in->type != FD_INODE &&
+        out->type == FD_PIPE && out->nonblock)
+    {
+      // another writer took the room found above. in can't
+      // take the rest back, so wait to write it.
+      iov.iov_base = page + w;
+      iov.iov_len = r - w;
+      if ((x = pipewritev(out->pipe, 0, &iov, 1, 0)) > 0)
+        w += x;
+    }
+    if (w > 0)
+      total += w;
+    if (w != r)
+    {
+      if (off < 0 && in->type == FD_INODE)
+      {
+        // give back to in what out didn't take.
+        ilock(in->ip);
+        in->off -= r - (w > 0 ? w : 0);
+        iunlock(in->ip);
+      }
+      r = w == 0 && out->nonblock ? -EAGAIN : -1;
+      break;
+    }
+    if (r < m)
+      break;
+  }
+  kfree(page);
+  if (total == 0 && r < 0)
+    return r == -EAGAIN ? r : -1;
+  return total;
+}
+
+// Move up to n bytes from file in to file out,
+// whatever kinds of file they are.
+int filesplice(struct file *in, struct file *out, int n)
+{
+  return filecopy(in, -1, out, n);
+}
+
+// Move up to n bytes of inode file in, starting at off,
+// to file out. in's offset is not used or changed.
+int filesendfile(struct file *out, struct file *in, int off, int n)
+{
+  if (in->type != FD_INODE || off < 0)
+    return -1;
+  return filecopy(in, off, out, n);
+}
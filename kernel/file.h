@@ -5,15 +5,18 @@ struct file
     FD_NONE,
     FD_PIPE,
     FD_INODE,
-    FD_DEVICE
+    FD_DEVICE,
+    FD_EPOLL
   } type;
   int ref; // reference count
   char readable;
   char writable;
+  char nonblock; // O_NONBLOCK: return -EAGAIN rather than wait
   struct pipe *pipe; // FD_PIPE
   struct inode *ip;  // FD_INODE and FD_DEVICE
   uint off;          // FD_INODE
   short major;       // FD_DEVICE
+  struct eventpoll *ep; // FD_EPOLL
 };
 
 #define major(dev) ((dev) >> 16 & 0xFFFF)
@@ -26,24 +29,39 @@ struct inode
   uint dev;              // Device number
   uint inum;             // Inode number
   int ref;               // Reference count
+  struct inode *hnext;   // itable hash chain, or free list
+  struct inode *prev;    // itable list of idle inodes (ref == 0)
+  struct inode *next;    // and, in fs.c, itruncd's list of inodes to free
   struct sleeplock lock; // protects everything below here
   int valid;             // inode has been read from disk?
 
   short type; // copy of disk inode
+  short flags;
   short major;
   short minor;
   short nlink;
   uint size;
-  uint addrs[NDIRECT + 1];
+  uint addrs[NADDRS];
+
+  uint pstart; // preallocation window: free blocks reserved
+  uint plen;   // for this file's next blocks; see balloc()
+
+  struct xentry xlast; // IF_EXTENT: the leaf extent bmap() found last
+  uint ilbase;         // else: the last-level indirect block that
+  uint ilblk;          // maps blocks ilbase..ilbase+NINDIRECT-1
 };
 
 // map major device number to device functions.
 struct devsw
 {
-  int (*read)(int, uint64, int);
+  int (*read)(int, uint64, int, int); // last argument: O_NONBLOCK
   int (*write)(int, uint64, int);
+  int (*poll)(void); // poll() events ready; 0 means always ready
+  int (*ioctl)(int, int); // device-specific requests
+  struct epitem *watch; // epoll items watching the device
 };
 
 extern struct devsw devsw[];
 
 #define CONSOLE 1
+#define STATS 2
@@ -26,6 +26,11 @@
 // only one device
 struct superblock sb;
 
+static void bsuminit(int dev);
+static void isuminit(int dev);
+static void orphaninit(void);
+static void orphanpend(struct inode *ip);
+
 // Read the super block.
 static void
 readsb(int dev, struct superblock *sb)
@@ -44,6 +49,9 @@ void fsinit(int dev)
   if (sb.magic != FSMAGIC)
     panic("invalid file system");
   initlog(dev, &sb);
+  bsuminit(dev);
+  orphaninit();
+  isuminit(dev);
 }
 
 // Zero a block.
@@ -60,34 +68,236 @@ bzero(int dev, int bno)
 
 // Blocks.
 
-// Allocate a zeroed disk block.
-// returns 0 if out of disk space.
-static uint
-balloc(uint dev)
+// Free-space summary: the number of free bits in each bitmap
+// block, so that balloc() reads only a bitmap block that has a
+// free block, and per-block rotors so that it doesn't re-test
+// bytes it knows are full. Built at fsinit() from the on-disk
+// bitmap; balloc() and bfree() keep it up to date while they
+// hold the bitmap block.
+//
+// balloc() takes a goal: the block that would make the file
+// contiguous, usually the one after the file's previous block.
+// It takes the goal or the next free block after it in the same
+// bitmap block, or else falls back to first-fit, which keeps
+// reusing recently freed (and likely cached) blocks.
+//
+// A file being appended to also gets a preallocation window:
+// up to NPREALLOC free blocks after the one just allocated,
+// reserved in memory (never on disk) so that files growing at
+// the same time don't interleave their blocks. The window is
+// given back when the file's last reference goes away, or when
+// the file allocates somewhere else.
+#define NBMAP (FSSIZE / BPB + 1)
+#define NPREALLOC 8
+
+static struct
+{
+  struct spinlock lock;
+  int n;            // bitmap blocks in use
+  int first;        // no free bits in bitmap blocks before this
+  int nfree[NBMAP]; // free, unclaimed, unreserved bits per bitmap block
+  int rotor[NBMAP]; // no free bits in bytes before this
+  uint free;        // free, unclaimed, unreserved blocks on the disk
+  uchar resv[NBMAP * BPB / 8]; // blocks in preallocation windows
+} bsum;
+
+#define RESERVED(b) (bsum.resv[(b) / 8] & (1 << ((b) % 8)))
+
+static void
+bsuminit(int dev)
 {
-  int b, bi, m;
   struct buf *bp;
+  int b, bi;
 
-  bp = 0;
+  initlock(&bsum.lock, "bsum");
+  bsum.n = (sb.size + BPB - 1) / BPB;
+  if (bsum.n > NBMAP)
+    panic("bsuminit: file system too big");
   for (b = 0; b < sb.size; b += BPB)
   {
     bp = bread(dev, BBLOCK(b, sb));
     for (bi = 0; bi < BPB && b + bi < sb.size; bi++)
     {
-      m = 1 << (bi % 8);
-      if ((bp->data[bi / 8] & m) == 0)
-      {                        // Is block free?
-        bp->data[bi / 8] |= m; // Mark block in use.
-        log_write(bp);
-        brelse(bp);
-        bzero(dev, b + bi);
-        return b + bi;
-      }
+      if ((bp->data[bi / 8] & (1 << (bi % 8))) == 0)
+        bsum.nfree[b / BPB]++;
     }
+    bsum.free += bsum.nfree[b / BPB];
     brelse(bp);
   }
-  printf("balloc: out of blocks\n");
-  return 0;
+}
+
+// Claim a free bit in bitmap block i if it has one, else in
+// the first bitmap block that has one, so that no one else
+// counts on it. Returns the bitmap block's index, or -1 if the
+// disk is full.
+static int
+bclaim(int i)
+{
+  acquire(&bsum.lock);
+  if (i < 0 || i >= bsum.n || bsum.nfree[i] == 0)
+  {
+    for (i = bsum.first; i < bsum.n; i++)
+    {
+      if (bsum.nfree[i] > 0)
+        break;
+    }
+    bsum.first = i;
+    if (i == bsum.n)
+    {
+      release(&bsum.lock);
+      return -1;
+    }
+  }
+  bsum.nfree[i]--;
+  bsum.free--;
+  release(&bsum.lock);
+  return i;
+}
+
+// Is bit bi of bitmap block bp (block # b + bi) allocatable?
+static int
+bavail(struct buf *bp, uint b, int bi)
+{
+  return b + bi < sb.size && (bp->data[bi / 8] & (1 << (bi % 8))) == 0 &&
+         !RESERVED(b + bi);
+}
+
+// Give back ip's preallocation window.
+static void
+bunreserve(struct inode *ip)
+{
+  uint b;
+
+  if (ip->plen == 0)
+    return;
+  acquire(&bsum.lock);
+  for (b = ip->pstart; b < ip->pstart + ip->plen; b++)
+    bsum.resv[b / 8] &= ~(1 << (b % 8));
+  b = ip->pstart;
+  bsum.nfree[b / BPB] += ip->plen;
+  bsum.free += ip->plen;
+  if ((b % BPB) / 8 < bsum.rotor[b / BPB])
+    bsum.rotor[b / BPB] = (b % BPB) / 8;
+  if (b / BPB < bsum.first)
+    bsum.first = b / BPB;
+  release(&bsum.lock);
+  ip->pstart = ip->plen = 0;
+}
+
+// Reserve a window for ip of the free blocks after bit bi
+// of bitmap block bp, which the caller holds.
+static void
+breserve(struct inode *ip, struct buf *bp, uint b, int bi)
+{
+  int n;
+
+  acquire(&bsum.lock);
+  for (n = 0; n < NPREALLOC && n < bsum.nfree[b / BPB]; n++)
+  {
+    if (bi + 1 + n >= BPB || !bavail(bp, b, bi + 1 + n))
+      break;
+    bsum.resv[(b + bi + 1 + n) / 8] |= 1 << ((b + bi + 1 + n) % 8);
+  }
+  bsum.nfree[b / BPB] -= n;
+  bsum.free -= n;
+  release(&bsum.lock);
+  ip->pstart = b + bi + 1;
+  ip->plen = n;
+}
+
+// Allocate a zeroed disk block for ip, as close after goal
+// as possible (goal 0 means anywhere). A data block (data set)
+// comes from ip's preallocation window if goal is its next
+// block, or else starts a new window; any other block leaves
+// the window alone, and never lands in it.
+// returns 0 if out of disk space.
+static uint
+balloc1(struct inode *ip, uint goal, int data)
+{
+  int i, bi, m, found;
+  uint b, dev = ip->dev;
+  struct buf *bp;
+
+  if (data && ip->plen > 0 && goal == ip->pstart)
+  {
+    // the next block of ip's preallocation window.
+    b = goal - goal % BPB;
+    bi = goal % BPB;
+    bp = bread(dev, BBLOCK(b, sb));
+    m = 1 << (bi % 8);
+    if (bp->data[bi / 8] & m)
+      panic("balloc: window");
+    bp->data[bi / 8] |= m;
+    log_write(bp);
+    acquire(&bsum.lock);
+    bsum.resv[goal / 8] &= ~(1 << (goal % 8));
+    release(&bsum.lock);
+    brelse(bp);
+    ip->pstart++;
+    ip->plen--;
+    bzero(dev, goal);
+    return goal;
+  }
+  if (data)
+    bunreserve(ip);
+
+  if ((i = bclaim(goal > 0 && goal < sb.size ? goal / BPB : -1)) < 0)
+  {
+    printf("balloc: out of blocks\n");
+    return 0;
+  }
+
+  // bclaim() guarantees a free bit in bitmap block i, at or
+  // after its rotor. try from the goal first.
+  b = i * BPB;
+  bp = bread(dev, BBLOCK(b, sb));
+  found = 0;
+  if (goal >= b && goal < b + BPB)
+  {
+    for (bi = goal - b; bi < BPB && b + bi < sb.size; bi++)
+    {
+      if (bavail(bp, b, bi))
+      {
+        found = 1;
+        break;
+      }
+    }
+  }
+  if (!found)
+  {
+    for (bi = bsum.rotor[i] * 8; bi < BPB && b + bi < sb.size; bi++)
+    {
+      if (bp->data[bi / 8] == 0xff)
+      {
+        bi |= 7; // skip a full byte
+        continue;
+      }
+      if (bavail(bp, b, bi))
+      {
+        found = 1;
+        break;
+      }
+    }
+    if (!found)
+      panic("balloc: summary out of date");
+    acquire(&bsum.lock);
+    bsum.rotor[i] = bi / 8;
+    release(&bsum.lock);
+  }
+
+  bp->data[bi / 8] |= 1 << (bi % 8); // Mark block in use.
+  log_write(bp);
+  if (data)
+    breserve(ip, bp, b, bi);
+  brelse(bp);
+  bzero(dev, b + bi);
+  return b + bi;
+}
+
+static uint
+balloc(struct inode *ip, uint goal)
+{
+  return balloc1(ip, goal, 1);
 }
 
 // Free a disk block.
@@ -104,6 +314,15 @@ bfree(int dev, uint b)
     panic("freeing free block");
   bp->data[bi / 8] &= ~m;
   log_write(bp);
+
+  acquire(&bsum.lock);
+  bsum.nfree[b / BPB]++;
+  bsum.free++;
+  if (bi / 8 < bsum.rotor[b / BPB])
+    bsum.rotor[b / BPB] = bi / 8;
+  if (b / BPB < bsum.first)
+    bsum.first = b / BPB;
+  release(&bsum.lock);
   brelse(bp);
 }
 
@@ -132,18 +351,23 @@ bfree(int dev, uint b)
 //   is non-zero. ialloc() allocates, and iput() frees if
 //   the reference and link counts have fallen to zero.
 //
-// * Referencing in table: an entry in the inode table
-//   is free if ip->ref is zero. Otherwise ip->ref tracks
-//   the number of in-memory pointers to the entry (open
-//   files and current directories). iget() finds or
-//   creates a table entry and increments its ref; iput()
-//   decrements ref.
+// * Referencing in table: ip->ref tracks the number of
+//   in-memory pointers to a table entry (open files and
+//   current directories). iget() finds or creates a table
+//   entry and increments its ref; iput() decrements ref.
+//   An entry whose ref has fallen to zero stays in the
+//   table, idle, so that the next iget() of the same inode
+//   finds it, until it is among the least recently used of
+//   more than NINODE idle entries. The table has no fixed
+//   size: it grows a page of entries at a time when every
+//   entry is in use.
 //
 // * Valid: the information (type, size, &c) in an inode
 //   table entry is only correct when ip->valid is 1.
-//   ilock() reads the inode from
-//   the disk and sets ip->valid, while iput() clears
-//   ip->valid if ip->ref has fallen to zero.
+//   ilock() reads the inode from the disk and sets
+//   ip->valid, and iput() clears it when it frees the
+//   inode. An idle entry stays valid, so ilock() of a
+//   recently closed file needn't read the disk.
 //
 // * Locked: file system code may only examine and modify
 //   the information in an inode and its content if it
@@ -168,56 +392,193 @@ bfree(int dev, uint b)
 // multi-step atomic operations.
 //
 // The itable.lock spin-lock protects the allocation of itable
-// entries. Since ip->ref indicates whether an entry is free,
+// entries. Since ip->ref indicates whether an entry is idle,
 // and ip->dev and ip->inum indicate which i-node an entry
-// holds, one must hold itable.lock while using any of those fields.
+// holds, one must hold itable.lock while using any of those
+// fields, or the hash, free and idle lists.
 //
 // An ip->lock sleep-lock protects all ip-> fields other than ref,
 // dev, and inum.  One must hold ip->lock in order to
 // read or write that inode's ip->valid, ip->size, ip->type, &c.
 
+#define NIHASH 61 // itable hash chains
+
 struct
 {
   struct spinlock lock;
-  struct inode inode[NINODE];
+  struct inode *hash[NIHASH]; // entries in use or idle, by (dev, inum)
+  struct inode *free;         // unused entries, through hnext
+
+  // Linked list of idle entries, through prev/next.
+  // idle.next is most recently used, idle.prev is least.
+  struct inode idle;
+  int nidle;
+  int n; // entries allocated
+
+  uint64 hits;   // iget()s that found the inode in the table
+  uint64 misses; // iget()s that had to take a new entry
 } itable;
 
 void iinit()
 {
-  int i = 0;
-
   initlock(&itable.lock, "itable");
-  for (i = 0; i < NINODE; i++)
+  itable.idle.prev = &itable.idle;
+  itable.idle.next = &itable.idle;
+}
+
+static struct inode **
+ichain(uint dev, uint inum)
+{
+  return &itable.hash[(dev * 31 + inum) % NIHASH];
+}
+
+// Take ip off its hash chain and put it on the free list.
+// Caller must hold itable.lock.
+static void
+iforget(struct inode *ip)
+{
+  struct inode **pp;
+
+  for (pp = ichain(ip->dev, ip->inum); *pp != ip; pp = &(*pp)->hnext)
+    ;
+  *pp = ip->hnext;
+  ip->hnext = itable.free;
+  itable.free = ip;
+}
+
+// Take ip off the idle list.
+static void
+iunidle(struct inode *ip)
+{
+  ip->next->prev = ip->prev;
+  ip->prev->next = ip->next;
+  itable.nidle--;
+}
+
+// An unused table entry: from the free list, or a fresh page
+// of them, or else the least recently used idle entry.
+// Caller must hold itable.lock.
+static struct inode *
+inew(void)
+{
+  struct inode *ip;
+  char *p;
+
+  if (itable.free == 0 && (p = kalloc()) != 0)
+  {
+    memset(p, 0, PGSIZE);
+    for (ip = (struct inode *)p; ip + 1 <= (struct inode *)(p + PGSIZE); ip++)
+    {
+      initsleeplock(&ip->lock, "inode");
+      ip->hnext = itable.free;
+      itable.free = ip;
+      itable.n++;
+    }
+  }
+  if (itable.free == 0)
   {
-    initsleeplock(&itable.inode[i].lock, "inode");
+    if (itable.nidle == 0)
+      panic("iget: no inodes");
+    ip = itable.idle.prev;
+    iunidle(ip);
+    iforget(ip);
   }
+  ip = itable.free;
+  itable.free = ip->hnext;
+  return ip;
 }
 
 static struct inode *iget(uint dev, uint inum);
 
+// Free-inode summary: the number of free inodes in each inode
+// block, counted at fsinit(), so that ialloc() reads only an
+// inode block that has a free inode. ialloc() and iupdate()
+// keep the counts exact while they hold the inode block.
+// The count also finds the orphans a crash left behind.
+#define NIBLOCK (FSSIZE / IPB + 1)
+
+static struct
+{
+  struct spinlock lock;
+  int n;                // inode blocks
+  uchar nfree[NIBLOCK]; // free inodes in each
+} isum;
+
+static void
+isuminit(int dev)
+{
+  struct buf *bp;
+  struct dinode *dip;
+  uint inum;
+  int b;
+
+  initlock(&isum.lock, "isum");
+  isum.n = sb.ninodes / IPB + 1;
+  if (isum.n > NIBLOCK)
+    panic("isuminit: too many inodes");
+  for (b = 0; b < isum.n; b++)
+  {
+    bp = bread(dev, sb.inodestart + b);
+    for (inum = b * IPB; inum < (b + 1) * IPB && inum < sb.ninodes; inum++)
+    {
+      dip = (struct dinode *)bp->data + inum % IPB;
+      if (inum > 0 && dip->type == 0)
+        isum.nfree[b]++;
+      else if (inum > 0 && (dip->flags & IF_ORPHAN))
+        orphanpend(iget(dev, inum));
+    }
+    brelse(bp);
+  }
+}
+
 // Allocate an inode on device dev.
 // Mark it as allocated by  giving it type type.
+// Prefer the inode block of inode near (the new inode's parent
+// directory), so that a directory's inodes tend to share blocks,
+// then the blocks after it.
 // Returns an unlocked but allocated and referenced inode,
 // or NULL if there is no free inode.
 struct inode *
-ialloc(uint dev, short type)
+ialloc(uint dev, short type, uint near)
 {
-  int inum;
+  uint inum;
+  int b, i;
   struct buf *bp;
   struct dinode *dip;
 
-  for (inum = 1; inum < sb.ninodes; inum++)
+  for (;;)
   {
-    bp = bread(dev, IBLOCK(inum, sb));
-    dip = (struct dinode *)bp->data + inum % IPB;
-    if (dip->type == 0)
-    { // a free inode
-      memset(dip, 0, sizeof(*dip));
-      dip->type = type;
-      log_write(bp); // mark it allocated on the disk
-      brelse(bp);
-      return iget(dev, inum);
+    acquire(&isum.lock);
+    b = near / IPB;
+    for (i = 0; i < isum.n && isum.nfree[(b + i) % isum.n] == 0; i++)
+      ;
+    b = (b + i) % isum.n;
+    release(&isum.lock);
+    if (i == isum.n)
+      break;
+
+    bp = bread(dev, sb.inodestart + b);
+    for (inum = b * IPB; inum < (b + 1) * IPB && inum < sb.ninodes; inum++)
+    {
+      dip = (struct dinode *)bp->data + inum % IPB;
+      if (inum > 0 && dip->type == 0)
+      { // a free inode
+        memset(dip, 0, sizeof(*dip));
+        dip->type = type;
+        if (type == T_FILE)
+          dip->flags = IF_INLINE | IF_EXTENT; // extent-mapped once it outgrows inline
+        log_write(bp); // mark it allocated on the disk
+        acquire(&isum.lock);
+        isum.nfree[b]--;
+        release(&isum.lock);
+        brelse(bp);
+        return iget(dev, inum);
+      }
     }
+    // another process took the last one.
+    acquire(&isum.lock);
+    isum.nfree[b] = 0;
+    release(&isum.lock);
     brelse(bp);
   }
   printf("ialloc: no inodes\n");
@@ -235,7 +596,15 @@ void iupdate(struct inode *ip)
 
   bp = bread(ip->dev, IBLOCK(ip->inum, sb));
   dip = (struct dinode *)bp->data + ip->inum % IPB;
+  if (dip->type != 0 && ip->type == 0)
+  {
+    // iput() is freeing it.
+    acquire(&isum.lock);
+    isum.nfree[ip->inum / IPB]++;
+    release(&isum.lock);
+  }
   dip->type = ip->type;
+  dip->flags = ip->flags;
   dip->major = ip->major;
   dip->minor = ip->minor;
   dip->nlink = ip->nlink;
@@ -251,33 +620,34 @@ void iupdate(struct inode *ip)
 static struct inode *
 iget(uint dev, uint inum)
 {
-  struct inode *ip, *empty;
+  struct inode *ip, **pp;
 
   acquire(&itable.lock);
 
   // Is the inode already in the table?
-  empty = 0;
-  for (ip = &itable.inode[0]; ip < &itable.inode[NINODE]; ip++)
+  pp = ichain(dev, inum);
+  for (ip = *pp; ip; ip = ip->hnext)
   {
-    if (ip->ref > 0 && ip->dev == dev && ip->inum == inum)
+    if (ip->dev == dev && ip->inum == inum)
     {
+      if (ip->ref == 0)
+        iunidle(ip);
       ip->ref++;
+      itable.hits++;
       release(&itable.lock);
       return ip;
     }
-    if (empty == 0 && ip->ref == 0) // Remember empty slot.
-      empty = ip;
   }
 
-  // Recycle an inode entry.
-  if (empty == 0)
-    panic("iget: no inodes");
-
-  ip = empty;
+  // Take a new entry.
+  itable.misses++;
+  ip = inew();
   ip->dev = dev;
   ip->inum = inum;
   ip->ref = 1;
   ip->valid = 0;
+  ip->hnext = *pp;
+  *pp = ip;
   release(&itable.lock);
 
   return ip;
@@ -311,12 +681,15 @@ void ilock(struct inode *ip)
     bp = bread(ip->dev, IBLOCK(ip->inum, sb));
     dip = (struct dinode *)bp->data + ip->inum % IPB;
     ip->type = dip->type;
+    ip->flags = dip->flags;
     ip->major = dip->major;
     ip->minor = dip->minor;
     ip->nlink = dip->nlink;
     ip->size = dip->size;
     memmove(ip->addrs, dip->addrs, sizeof(ip->addrs));
     brelse(bp);
+    ip->xlast.len = 0;
+    ip->ilblk = 0;
     ip->valid = 1;
     if (ip->type == 0)
       panic("ilock: no type");
@@ -343,9 +716,16 @@ void iput(struct inode *ip)
 {
   acquire(&itable.lock);
 
+  if (ip->ref == 1)
+  {
+    // no one else can be using ip's preallocation window.
+    bunreserve(ip);
+  }
+
   if (ip->ref == 1 && ip->valid && ip->nlink == 0)
   {
-    // inode has no links and no other references: truncate and free.
+    // inode has no links and no other references: truncate and free,
+    // or for a big file, leave that to itruncd.
 
     // ip->ref == 1 means no other process can have ip locked,
     // so this acquiresleep() won't block (or deadlock).
@@ -353,10 +733,25 @@ void iput(struct inode *ip)
 
     release(&itable.lock);
 
-    itrunc(ip);
-    ip->type = 0;
-    iupdate(ip);
-    ip->valid = 0;
+    if (ip->type == T_DIR)
+      dcache_purge(ip->dev, ip->inum);
+    if (ip->size <= NDIRECT * BSIZE)
+    {
+      itrunc(ip);
+      ip->type = 0;
+      iupdate(ip);
+      ip->valid = 0;
+    }
+    else
+    {
+      // mark it an orphan on disk, in the caller's transaction,
+      // and give ip, and this reference, to itruncd.
+      ip->flags |= IF_ORPHAN;
+      iupdate(ip);
+      releasesleep(&ip->lock);
+      orphanpend(ip);
+      return;
+    }
 
     releasesleep(&ip->lock);
 
@@ -364,7 +759,37 @@ void iput(struct inode *ip)
   }
 
   ip->ref--;
+  if (ip->ref == 0 && !ip->valid)
+  {
+    iforget(ip);
+  }
+  else if (ip->ref == 0)
+  {
+    // keep it, most recently used first.
+    ip->next = itable.idle.next;
+    ip->prev = &itable.idle;
+    ip->next->prev = ip;
+    itable.idle.next = ip;
+    itable.nidle++;
+    if (itable.nidle > NINODE)
+    {
+      ip = itable.idle.prev;
+      iunidle(ip);
+      iforget(ip);
+    }
+  }
+  release(&itable.lock);
+}
+
+int icache_stats(char *buf, int sz)
+{
+  int n;
+
+  acquire(&itable.lock);
+  n = snprintf(buf, sz, "icache: inodes %d idle %d hits %lu misses %lu\n",
+               itable.n, itable.nidle, itable.hits, itable.misses);
   release(&itable.lock);
+  return n;
 }
 
 // Common idiom: unlock, then put.
@@ -374,131 +799,785 @@ void iunlockput(struct inode *ip)
   iput(ip);
 }
 
-// Inode content
+// Extent trees (IF_EXTENT).
 //
-// The content (data) associated with each inode is stored
-// in blocks on the disk. The first NDIRECT block numbers
-// are listed in ip->addrs[].  The next NINDIRECT blocks are
-// listed in block ip->addrs[NDIRECT].
+// Files never have holes: writei() only writes at or before
+// the end of the file, so bmap() only ever allocates the block
+// just after the last mapped one. The tree therefore only grows
+// at its right edge: a new block extends the last extent if it
+// is contiguous with it, and otherwise becomes a new extent at
+// the end of the rightmost leaf. A full node gets a new sibling
+// to its right, and a full root moves into a block of its own,
+// one level down.
+//
+// ip->xlast caches the last leaf extent bmap() found, so that
+// mapping a run of blocks in a contiguous extent costs a single
+// tree lookup, and so no bread() of leaf blocks.
 
-// Return the disk block address of the nth block in inode ip.
-// If there is no such block, bmap allocates one.
-// returns 0 if out of disk space.
-static uint
-bmap(struct inode *ip, uint bn)
+#define XMAXDEPTH 5
+
+#define XROOT(ip) ((struct xheader *)(ip)->addrs)
+#define XENT(h) ((struct xentry *)((h) + 1))
+
+// Read tree block b, checking that it holds a node of the
+// expected depth.
+static struct buf *
+xread(struct inode *ip, uint b, int depth)
 {
-  uint addr, *a;
-  struct buf *bp;
+  struct buf *bp = bread(ip->dev, b);
+  struct xheader *h = (struct xheader *)bp->data;
 
-  if (bn < NDIRECT)
+  if (h->depth != depth || h->n > NXBLOCK)
+    panic("xread: bad extent node");
+  return bp;
+}
+
+// Find the leaf extent that maps file block bn, or failing
+// that the last extent in the tree, in *e. Returns 1 if e
+// maps bn, 0 if not (e->len is 0 for an empty tree).
+static int
+xfind(struct inode *ip, uint bn, struct xentry *e)
+{
+  struct xheader *h = XROOT(ip);
+  struct buf *bp = 0;
+  int i;
+
+  if (ip->xlast.len > 0 && bn >= ip->xlast.lblk && bn - ip->xlast.lblk < ip->xlast.len)
   {
-    if ((addr = ip->addrs[bn]) == 0)
-    {
-      addr = balloc(ip->dev);
-      if (addr == 0)
-        return 0;
-      ip->addrs[bn] = addr;
-    }
-    return addr;
+    *e = ip->xlast;
+    return 1;
   }
-  bn -= NDIRECT;
 
-  if (bn < NINDIRECT)
+  e->len = 0;
+  while (1)
   {
-    // Load indirect block, allocating if necessary.
-    if ((addr = ip->addrs[NDIRECT]) == 0)
-    {
-      addr = balloc(ip->dev);
-      if (addr == 0)
-        return 0;
-      ip->addrs[NDIRECT] = addr;
-    }
-    bp = bread(ip->dev, addr);
-    a = (uint *)bp->data;
-    if ((addr = a[bn]) == 0)
+    struct xentry *x = XENT(h);
+    int depth = h->depth;
+
+    // the last entry starting at or before bn.
+    for (i = h->n - 1; i > 0 && x[i].lblk > bn; i--)
+      ;
+    if (h->n == 0)
+      break;
+    if (depth == 0)
     {
-      addr = balloc(ip->dev);
-      if (addr)
-      {
-        a[bn] = addr;
-        log_write(bp);
-      }
+      *e = x[i];
+      break;
     }
+    uint child = x[i].start;
+    if (bp)
+      brelse(bp);
+    bp = xread(ip, child, depth - 1);
+    h = (struct xheader *)bp->data;
+  }
+  if (bp)
     brelse(bp);
-    return addr;
+
+  if (e->len > 0 && bn >= e->lblk && bn - e->lblk < e->len)
+  {
+    ip->xlast = *e;
+    return 1;
   }
+  return 0;
+}
 
-  panic("bmap: out of range");
+// Allocate a block for a tree node, anywhere but in ip's
+// preallocation window: the file's next blocks come from there,
+// and a node in it would start a new extent.
+static uint
+xballoc(struct inode *ip)
+{
+  return balloc1(ip, 0, 0);
 }
 
-// Truncate inode (discard contents).
-// Caller must hold ip->lock.
-void itrunc(struct inode *ip)
+// Add e as the last entry of the rightmost node at depth
+// depth, making room as needed. Returns 0 if out of blocks.
+static int
+xinsert(struct inode *ip, struct xentry *e, int depth)
 {
-  int i, j;
+  struct xheader *h = XROOT(ip);
   struct buf *bp;
-  uint *a;
+  uint b, nb;
+  int d;
 
-  for (i = 0; i < NDIRECT; i++)
+  if (h->depth == depth)
   {
-    if (ip->addrs[i])
+    if (h->n < NXROOT)
     {
-      bfree(ip->dev, ip->addrs[i]);
-      ip->addrs[i] = 0;
+      XENT(h)[h->n++] = *e;
+      return 1;
     }
+    // the root is full: move it into a block of its own,
+    // which has room, and make the root point to it.
+    if (h->depth + 1 >= XMAXDEPTH)
+      panic("xinsert: tree too deep");
+    if ((nb = xballoc(ip)) == 0)
+      return 0;
+    bp = bread(ip->dev, nb);
+    memmove(bp->data, h, sizeof(*h) + h->n * sizeof(struct xentry));
+    log_write(bp);
+    brelse(bp);
+    h->depth += 1;
+    h->n = 1;
+    XENT(h)[0].start = nb;
+    XENT(h)[0].len = 0;
   }
 
-  if (ip->addrs[NDIRECT])
+  // the rightmost node at depth.
+  b = XENT(h)[h->n - 1].start;
+  for (d = h->depth - 1; d > depth; d--)
   {
-    bp = bread(ip->dev, ip->addrs[NDIRECT]);
-    a = (uint *)bp->data;
-    for (j = 0; j < NINDIRECT; j++)
-    {
-      if (a[j])
-        bfree(ip->dev, a[j]);
-    }
+    bp = xread(ip, b, d);
+    struct xheader *bh = (struct xheader *)bp->data;
+    b = XENT(bh)[bh->n - 1].start;
+    brelse(bp);
+  }
+  bp = xread(ip, b, depth);
+  h = (struct xheader *)bp->data;
+  if (h->n < NXBLOCK)
+  {
+    XENT(h)[h->n++] = *e;
+    log_write(bp);
     brelse(bp);
-    bfree(ip->dev, ip->addrs[NDIRECT]);
-    ip->addrs[NDIRECT] = 0;
+    return 1;
   }
+  brelse(bp);
 
-  ip->size = 0;
-  iupdate(ip);
+  // full: start a sibling to its right, and add that
+  // to the parent.
+  if ((nb = xballoc(ip)) == 0)
+    return 0;
+  bp = bread(ip->dev, nb);
+  h = (struct xheader *)bp->data;
+  h->n = 1;
+  h->depth = depth;
+  XENT(h)[0] = *e;
+  log_write(bp);
+  brelse(bp);
+
+  struct xentry x = {e->lblk, nb, 0};
+  return xinsert(ip, &x, depth + 1);
 }
 
-// Copy stat information from inode.
-// Caller must hold ip->lock.
-void stati(struct inode *ip, struct stat *st)
+// Extend the last leaf extent, which ends at file block
+// e->lblk + e->len, by one block.
+static void
+xextend(struct inode *ip, struct xentry *e)
 {
-  st->dev = ip->dev;
-  st->ino = ip->inum;
-  st->type = ip->type;
-  st->nlink = ip->nlink;
-  st->size = ip->size;
+  struct xheader *h = XROOT(ip);
+  struct buf *bp = 0;
+  int d;
+
+  while ((d = h->depth) > 0)
+  {
+    uint child = XENT(h)[h->n - 1].start;
+    if (bp)
+      brelse(bp);
+    bp = xread(ip, child, d - 1);
+    h = (struct xheader *)bp->data;
+  }
+  if (XENT(h)[h->n - 1].lblk != e->lblk)
+    panic("xextend");
+  XENT(h)[h->n - 1].len += 1;
+  if (bp)
+  {
+    log_write(bp);
+    brelse(bp);
+  } // else the root: the caller's iupdate() writes it.
 }
 
-// Read data from inode.
-// Caller must hold ip->lock.
-// If user_dst==1, then dst is a user virtual address;
-// otherwise, dst is a kernel address.
-int readi(struct inode *ip, int user_dst, uint64 dst, uint off, uint n)
+// bmap() for extent-mapped inodes. If alloc is set, allocate
+// bn if it isn't mapped yet (it must be the block after the
+// last one). Returns 0 if bn isn't mapped, or out of blocks.
+static uint
+xbmap(struct inode *ip, uint bn, int alloc)
 {
-  uint tot, m;
-  struct buf *bp;
+  struct xentry e;
+  uint addr, end;
 
-  if (off > ip->size || off + n < off)
+  if (xfind(ip, bn, &e))
+    return e.start + (bn - e.lblk);
+  if (!alloc)
     return 0;
-  if (off + n > ip->size)
-    n = ip->size - off;
 
-  for (tot = 0; tot < n; tot += m, off += m, dst += m)
+  end = e.len > 0 ? e.lblk + e.len : 0;
+  if (bn != end)
+    panic("xbmap: hole");
+  addr = balloc(ip, e.len > 0 ? e.start + e.len : 0);
+  if (addr == 0)
+    return 0;
+  if (e.len > 0 && addr == e.start + e.len)
   {
-    uint addr = bmap(ip, off / BSIZE);
-    if (addr == 0)
-      break;
-    bp = bread(ip->dev, addr);
-    m = min(n - tot, BSIZE - off % BSIZE);
-    if (either_copyout(user_dst, dst, bp->data + (off % BSIZE), m) == -1)
+    xextend(ip, &e);
+    e.len += 1;
+  }
+  else
+  {
+    e.lblk = bn;
+    e.start = addr;
+    e.len = 1;
+    if (!xinsert(ip, &e, 0))
+    {
+      bfree(ip->dev, addr);
+      return 0;
+    }
+  }
+  ip->xlast = e;
+  return addr;
+}
+
+// Free the blocks mapped by the node h at depth depth,
+// and its subtree's blocks.
+static void
+xfree(struct inode *ip, struct xheader *h)
+{
+  struct xentry *x = XENT(h);
+  struct buf *bp;
+  int i;
+  uint b;
+
+  for (i = 0; i < h->n; i++)
+  {
+    if (h->depth == 0)
+    {
+      for (b = x[i].start; b < x[i].start + x[i].len; b++)
+        bfree(ip->dev, b);
+    }
+    else
+    {
+      bp = xread(ip, x[i].start, h->depth - 1);
+      xfree(ip, (struct xheader *)bp->data);
+      brelse(bp);
+      bfree(ip->dev, x[i].start);
+    }
+  }
+}
+
+// Discard an extent-mapped inode's blocks, leaving an empty tree.
+static void
+xtrunc(struct inode *ip)
+{
+  xfree(ip, XROOT(ip));
+  XROOT(ip)->n = 0;
+  XROOT(ip)->depth = 0;
+  ip->xlast.len = 0;
+}
+
+// Inode content
+//
+// The content (data) associated with each inode is stored
+// in blocks on the disk. The first NDIRECT block numbers
+// are listed in ip->addrs[].  The next NINDIRECT blocks are
+// listed in block ip->addrs[NDIRECT], the next NDINDIRECT
+// in the blocks listed in the doubly-indirect block
+// ip->addrs[NDIRECT+1], and the next NTINDIRECT below the
+// triply-indirect block ip->addrs[NDIRECT+2].
+//
+// Extent-mapped inodes (IF_EXTENT) are handled by the x*()
+// functions above instead.
+
+// Look up block bn of the tree of levels indirect blocks
+// rooted at *root, allocating missing blocks if alloc is set.
+// A missing block's goal is just after its left neighbour, or
+// after its parent for a first child, so that each indirect
+// block sits between the blocks before and after it.
+// Remembers the last-level indirect block in ip->ilblk.
+// returns 0 if there is no block, or out of disk space.
+static uint
+imap(struct inode *ip, uint *root, uint goal, int levels, uint base, uint bn, int alloc)
+{
+  uint addr, span, i, *a;
+  struct buf *bp;
+
+  if ((addr = *root) == 0)
+  {
+    if (goal == 0 && ip->plen > 0)
+      goal = ip->pstart; // carry on where the file left off
+    if (!alloc || (addr = balloc(ip, goal)) == 0)
+      return 0;
+    *root = addr; // the caller's iupdate() writes it
+  }
+
+  for (span = 1, i = 1; i < levels; i++)
+    span *= NINDIRECT;
+  for (; levels > 0; levels--, span /= NINDIRECT)
+  {
+    if (levels == 1)
+    {
+      ip->ilbase = base + bn - bn % NINDIRECT;
+      ip->ilblk = addr;
+    }
+    bp = bread(ip->dev, addr);
+    a = (uint *)bp->data;
+    i = bn / span;
+    bn %= span;
+    if (a[i] == 0)
+    {
+      if (!alloc || (a[i] = balloc(ip, (i > 0 && a[i - 1] ? a[i - 1] : addr) + 1)) == 0)
+      {
+        brelse(bp);
+        return 0;
+      }
+      log_write(bp);
+    }
+    addr = a[i];
+    brelse(bp);
+  }
+  return addr;
+}
+
+// Return the disk block address of the nth block in inode ip.
+// If there is no such block and alloc is set, allocate one.
+// returns 0 if there is no block, or out of disk space.
+//
+// Streaming through a file walks the same last-level indirect
+// block NINDIRECT times in a row, so ip->ilblk remembers it, and
+// a hit reads only that block instead of the whole chain.
+static uint
+bmap1(struct inode *ip, uint bn, int alloc)
+{
+  uint addr, base;
+
+  if (ip->flags & IF_INLINE)
+  {
+    if (alloc)
+      panic("bmap: inline");
+    return 0;
+  }
+  if (ip->flags & IF_EXTENT)
+    return xbmap(ip, bn, alloc);
+
+  // allocate each block right after the one before it in the
+  // file, if possible.
+  if (bn < NDIRECT)
+  {
+    if ((addr = ip->addrs[bn]) == 0 && alloc)
+    {
+      addr = balloc(ip, bn > 0 && ip->addrs[bn - 1] ? ip->addrs[bn - 1] + 1 : 0);
+      ip->addrs[bn] = addr;
+    }
+    return addr;
+  }
+
+  if (ip->ilblk && bn >= ip->ilbase && bn - ip->ilbase < NINDIRECT)
+    return imap(ip, &ip->ilblk, 0, 1, ip->ilbase, bn - ip->ilbase, alloc);
+
+  base = NDIRECT;
+  if (bn - base < NINDIRECT)
+    return imap(ip, &ip->addrs[NDIRECT], 0, 1, base, bn - base, alloc);
+  base += NINDIRECT;
+  if (bn - base < NDINDIRECT)
+    return imap(ip, &ip->addrs[NDIRECT + 1], 0, 2, base, bn - base, alloc);
+  base += NDINDIRECT;
+  if (bn - base < NTINDIRECT)
+    return imap(ip, &ip->addrs[NDIRECT + 2], 0, 3, base, bn - base, alloc);
+
+  panic("bmap: out of range");
+}
+
+// Return the disk block address of the nth block in inode ip.
+// If there is no such block, bmap allocates one.
+// returns 0 if out of disk space.
+static uint
+bmap(struct inode *ip, uint bn)
+{
+  return bmap1(ip, bn, 1);
+}
+
+// Return the disk block address of the nth block in inode ip,
+// or 0 if there is none. Unlike bmap(), never allocates.
+// Caller must hold ip->lock.
+uint ibmap(struct inode *ip, uint bn)
+{
+  if (!(ip->flags & IF_EXTENT) && bn >= MAXFILE)
+    return 0;
+  return bmap1(ip, bn, 0);
+}
+
+// Free indirect block addr, which is levels deep,
+// and every block below it.
+static void
+ifree(struct inode *ip, uint addr, int levels)
+{
+  struct buf *bp;
+  uint *a;
+  int j;
+
+  if (levels > 0)
+  {
+    bp = bread(ip->dev, addr);
+    a = (uint *)bp->data;
+    for (j = 0; j < NINDIRECT; j++)
+    {
+      if (a[j])
+        ifree(ip, a[j], levels - 1);
+    }
+    brelse(bp);
+  }
+  bfree(ip->dev, addr);
+}
+
+// Truncate inode (discard contents).
+// Caller must hold ip->lock.
+void itrunc(struct inode *ip)
+{
+  int i;
+
+  bunreserve(ip);
+  ip->ilblk = 0;
+  if (ip->flags & IF_INLINE)
+  {
+    memset(ip->addrs, 0, sizeof(ip->addrs));
+  }
+  else if (ip->flags & IF_EXTENT)
+  {
+    xtrunc(ip);
+  }
+
+  else
+  {
+    for (i = 0; i < NADDRS; i++)
+    {
+      if (ip->addrs[i])
+      {
+        // addrs[NDIRECT + k] is k+1 levels of indirect blocks.
+        ifree(ip, ip->addrs[i], i < NDIRECT ? 0 : i - NDIRECT + 1);
+        ip->addrs[i] = 0;
+      }
+    }
+  }
+
+  // an empty file starts out inline again.
+  if (ip->type == T_FILE)
+    ip->flags |= IF_INLINE;
+  ip->flags &= ~IF_DINDEX;
+  ip->size = 0;
+  iupdate(ip);
+}
+
+// Background truncation.
+//
+// Freeing all the blocks of a big file takes a while, so when
+// iput() frees an inode with more than NDIRECT blocks it just
+// marks it IF_ORPHAN on disk and hands it to a kernel thread,
+// itruncd. itruncd frees its blocks from the end, NTRUNC at a
+// time in transactions of their own, then frees the inode in
+// the last one. After a crash, isuminit() finds the inodes
+// still marked, and hands them to itruncd again.
+#define NTRUNC 32 // blocks freed per transaction
+#define NTRUNCMETA 8 // other blocks such a transaction may write
+
+static struct
+{
+  struct spinlock lock;
+  struct inode *pend; // orphans, linked by next, each with a reference
+} orphans;
+
+// Free the blocks of the subtree of a block-mapped inode at
+// addr (levels of indirect blocks, mapping file blocks from
+// base on) that map file blocks >= from.
+// returns 1 if that is all of them, and addr itself is freed.
+static int
+ifreefrom(struct inode *ip, uint addr, int levels, uint base, uint from)
+{
+  struct buf *bp;
+  uint *a, span;
+  int j, changed;
+
+  if (base >= from)
+  {
+    ifree(ip, addr, levels);
+    return 1;
+  }
+  if (levels == 0)
+    return 0;
+
+  for (span = 1, j = 1; j < levels; j++)
+    span *= NINDIRECT;
+  bp = bread(ip->dev, addr);
+  a = (uint *)bp->data;
+  changed = 0;
+  for (j = 0; j < NINDIRECT; j++)
+  {
+    if (a[j] && base + (j + 1) * span > from &&
+        ifreefrom(ip, a[j], levels - 1, base + j * span, from))
+    {
+      a[j] = 0;
+      changed = 1;
+    }
+  }
+  if (changed)
+    log_write(bp);
+  brelse(bp);
+  return 0;
+}
+
+// Free the blocks an extent node maps from file block from on,
+// removing or shortening its last entries.
+static void
+xfreefrom(struct inode *ip, struct xheader *h, uint from)
+{
+  struct xentry *x;
+  struct buf *bp;
+  uint b;
+
+  while (h->n > 0)
+  {
+    x = &XENT(h)[h->n - 1];
+    if (h->depth == 0)
+    {
+      if (x->lblk + x->len <= from)
+        return;
+      b = x->lblk >= from ? x->start : x->start + (from - x->lblk);
+      for (; b < x->start + x->len; b++)
+        bfree(ip->dev, b);
+      if (x->lblk < from)
+      {
+        x->len = from - x->lblk;
+        return;
+      }
+    }
+    else
+    {
+      bp = xread(ip, x->start, h->depth - 1);
+      if (x->lblk < from)
+      {
+        xfreefrom(ip, (struct xheader *)bp->data, from);
+        log_write(bp);
+        brelse(bp);
+        return;
+      }
+      xfree(ip, (struct xheader *)bp->data);
+      brelse(bp);
+      bfree(ip->dev, x->start);
+    }
+    h->n--;
+  }
+}
+
+// Shorten ip to its first nb blocks.
+// Caller must hold ip->lock.
+static void
+itruncto(struct inode *ip, uint nb)
+{
+  uint base, span;
+  int i;
+
+  if (nb * BSIZE >= ip->size || (ip->flags & IF_INLINE))
+    return;
+  bunreserve(ip);
+  ip->ilblk = 0;
+  ip->xlast.len = 0;
+  if (ip->flags & IF_EXTENT)
+  {
+    xfreefrom(ip, XROOT(ip), nb);
+    if (XROOT(ip)->n == 0)
+      XROOT(ip)->depth = 0;
+  }
+  else
+  {
+    base = 0;
+    span = 1;
+    for (i = 0; i < NADDRS; i++)
+    {
+      if (ip->addrs[i] && ifreefrom(ip, ip->addrs[i], i < NDIRECT ? 0 : i - NDIRECT + 1, base, nb))
+        ip->addrs[i] = 0;
+      if (i >= NDIRECT)
+        span *= NINDIRECT;
+      base += span;
+    }
+  }
+  ip->size = nb * BSIZE;
+  iupdate(ip);
+}
+
+// Give ip, and the caller's reference to it, to itruncd.
+static void
+orphanpend(struct inode *ip)
+{
+  acquire(&orphans.lock);
+  ip->next = orphans.pend;
+  orphans.pend = ip;
+  wakeup(&orphans);
+  release(&orphans.lock);
+}
+
+// the blocks a truncation step reserves; it may free
+// this many, less NTRUNCMETA.
+static int
+truncstep(void)
+{
+  int n;
+
+  n = NTRUNC + NTRUNCMETA;
+  if (n > log_maxop())
+    n = log_maxop();
+  return n;
+}
+
+// Truncate ip, like itrunc(), for a caller in a transaction
+// begun with begin_op(), which reserves only MAXOPBLOCKS blocks.
+// A file with more than NDIRECT blocks is first shortened from
+// the end in transactions of their own, as itruncd does it;
+// between steps ip is unlocked, and the caller's transaction
+// ended and begun again.
+// Caller must hold ip->lock.
+void itruncop(struct inode *ip)
+{
+  uint nb, step;
+  int n;
+
+  n = truncstep();
+  step = n - NTRUNCMETA;
+  while ((nb = (ip->size + BSIZE - 1) / BSIZE) > NDIRECT)
+  {
+    iunlock(ip);
+    end_op();
+    begin_opn(n);
+    ilock(ip);
+    nb = (ip->size + BSIZE - 1) / BSIZE;
+    itruncto(ip, nb > step ? nb - step : 0);
+    iunlock(ip);
+    end_opn(n);
+    begin_op();
+    ilock(ip);
+  }
+  itrunc(ip);
+}
+
+static void
+itruncd(void)
+{
+  struct inode *ip;
+  uint nb;
+  int n;
+
+  // each transaction may free n - NTRUNCMETA blocks.
+  n = truncstep();
+
+  for (;;)
+  {
+    acquire(&orphans.lock);
+    while (orphans.pend == 0)
+      sleep(&orphans, &orphans.lock);
+    ip = orphans.pend;
+    orphans.pend = ip->next;
+    release(&orphans.lock);
+
+    for (;;)
+    {
+      begin_opn(n);
+      ilock(ip);
+      nb = (ip->size + BSIZE - 1) / BSIZE;
+      if (nb <= n - NTRUNCMETA)
+        break;
+      itruncto(ip, nb - (n - NTRUNCMETA));
+      iunlock(ip);
+      end_opn(n);
+    }
+    itrunc(ip);
+    ip->type = 0;
+    iupdate(ip);
+    ip->valid = 0;
+    iunlockput(ip);
+    end_opn(n);
+  }
+}
+
+// Start itruncd. It waits for isuminit() and iput() to
+// hand it orphans.
+static void
+orphaninit(void)
+{
+  initlock(&orphans.lock, "orphans");
+  kthread(itruncd, "itruncd");
+}
+
+// Move an inline file's data out to a block of its own, so
+// that it can grow past NINLINE bytes.
+// returns -1 if out of disk space.
+static int
+iuninline(struct inode *ip)
+{
+  char data[NINLINE];
+  struct buf *bp;
+  uint addr;
+
+  memmove(data, ip->addrs, NINLINE);
+  memset(ip->addrs, 0, sizeof(ip->addrs));
+  ip->flags &= ~IF_INLINE;
+  ip->xlast.len = 0;
+  if (ip->size > 0)
+  {
+    if ((addr = bmap(ip, 0)) == 0)
+    {
+      memmove(ip->addrs, data, NINLINE);
+      ip->flags |= IF_INLINE;
+      return -1;
+    }
+    bp = bread(ip->dev, addr);
+    memmove(bp->data, data, ip->size);
+    log_write(bp);
+    brelse(bp);
+  }
+  iupdate(ip);
+  return 0;
+}
+
+// Switch ip, which must be empty, from the default mapping
+// to the block-mapped format (open()'s O_BLOCKMAP).
+// Caller must hold ip->lock.
+void iblockmap(struct inode *ip)
+{
+  if (ip->size != 0)
+    panic("iblockmap");
+  itrunc(ip);
+  ip->flags &= ~IF_EXTENT;
+  memset(ip->addrs, 0, sizeof(ip->addrs));
+  iupdate(ip);
+}
+
+// Copy stat information from inode.
+// Caller must hold ip->lock.
+void stati(struct inode *ip, struct stat *st)
+{
+  st->dev = ip->dev;
+  st->ino = ip->inum;
+  st->type = ip->type;
+  st->nlink = ip->nlink;
+  st->size = ip->size;
+}
+
+// Read data from inode.
+// Caller must hold ip->lock.
+// If user_dst==1, then dst is a user virtual address;
+// otherwise, dst is a kernel address.
+int readi(struct inode *ip, int user_dst, uint64 dst, uint off, uint n)
+{
+  uint tot, m;
+  struct buf *bp;
+
+  if (off > ip->size || off + n < off)
+    return 0;
+  if (off + n > ip->size)
+    n = ip->size - off;
+
+  if (ip->flags & IF_INLINE)
+  {
+    // the data is right here, in the inode.
+    if (either_copyout(user_dst, dst, (char *)ip->addrs + off, n) == -1)
+      return -1;
+    return n;
+  }
+
+  for (tot = 0; tot < n; tot += m, off += m, dst += m)
+  {
+    uint addr = bmap(ip, off / BSIZE);
+    if (addr == 0)
+      break;
+    bp = bread(ip->dev, addr);
+    m = min(n - tot, BSIZE - off % BSIZE);
+    if (either_copyout(user_dst, dst, bp->data + (off % BSIZE), m) == -1)
     {
       brelse(bp);
       tot = -1;
@@ -523,9 +1602,24 @@ int writei(struct inode *ip, int user_src, uint64 src, uint off, uint n)
 
   if (off > ip->size || off + n < off)
     return -1;
-  if (off + n > MAXFILE * BSIZE)
+  if (!(ip->flags & IF_EXTENT) && off + n > MAXFILE * BSIZE)
     return -1;
 
+  if (ip->flags & IF_INLINE)
+  {
+    if (off + n <= NINLINE)
+    {
+      if (either_copyin((char *)ip->addrs + off, user_src, src, n) == -1)
+        return -1;
+      if (off + n > ip->size)
+        ip->size = off + n;
+      iupdate(ip);
+      return n;
+    }
+    if (iuninline(ip) < 0)
+      return -1;
+  }
+
   for (tot = 0; tot < n; tot += m, off += m, src += m)
   {
     uint addr = bmap(ip, off / BSIZE);
@@ -560,18 +1654,356 @@ int namecmp(const char *s, const char *t)
   return strncmp(s, t, DIRSIZ);
 }
 
+// Indexed directories.
+//
+// A directory is a plain array of dirents until it outgrows its
+// first block; then it is converted to an indexed one (see
+// fs.h), so that finding a name, or room for one, reads the
+// root, maybe one index node, and one leaf, instead of every
+// block. A full leaf is split in two at a hash near its median,
+// and the index grows as leaves do. Leaves are never merged.
+
+// FNV-1a hash of a name.
+static uint
+dirhash(char *name)
+{
+  uint h = 2166136261;
+  int i;
+
+  for (i = 0; i < DIRSIZ && name[i]; i++)
+    h = (h ^ (uchar)name[i]) * 16777619;
+  return h;
+}
+
+// Read block bn of directory dp.
+static struct buf *
+dirblock(struct inode *dp, uint bn)
+{
+  uint addr;
+
+  if ((addr = bmap(dp, bn)) == 0)
+    panic("dirblock");
+  return bread(dp->dev, addr);
+}
+
+// Add an empty block to the end of directory dp.
+// returns its number, or 0 if out of disk space.
+static uint
+dirgrow(struct inode *dp)
+{
+  uint bn = dp->size / BSIZE;
+
+  if (bmap(dp, bn) == 0)
+    return 0;
+  dp->size += BSIZE;
+  iupdate(dp);
+  return bn;
+}
+
+// The index node in bp.
+static struct dxhead *
+dxnode(struct buf *bp, int root)
+{
+  return (struct dxhead *)((struct dirent *)bp->data + (root ? DXROOT : 0));
+}
+
+#define DXENT(h) ((struct dxentry *)((h) + 1))
+
+// Index of the last entry in node h whose hash is <= hash.
+static int
+dxpick(struct dxhead *h, uint hash)
+{
+  struct dxentry *e = DXENT(h);
+  int lo = 0, hi = h->n - 1, mid;
+
+  while (lo < hi)
+  {
+    mid = (lo + hi + 1) / 2;
+    if (e[mid].hash <= hash)
+      lo = mid;
+    else
+      hi = mid - 1;
+  }
+  return lo;
+}
+
+// Insert an entry at position i of node h, which has room.
+static void
+dxinsert(struct dxhead *h, int i, uint hash, uint blk)
+{
+  struct dxentry *e = DXENT(h);
+
+  memmove(e + i + 1, e + i, (h->n - i) * sizeof(*e));
+  memset(e + i, 0, sizeof(*e));
+  e[i].hash = hash;
+  e[i].blk = blk;
+  h->n++;
+}
+
+// The leaf block of directory dp for names with hash.
+static uint
+dxleaf(struct inode *dp, uint hash)
+{
+  struct buf *bp;
+  struct dxhead *h;
+  uint bn;
+  int depth;
+
+  bp = dirblock(dp, 0);
+  h = dxnode(bp, 1);
+  depth = h->depth;
+  bn = DXENT(h)[dxpick(h, hash)].blk;
+  brelse(bp);
+  if (depth > 0)
+  {
+    bp = dirblock(dp, bn);
+    h = dxnode(bp, 0);
+    bn = DXENT(h)[dxpick(h, hash)].blk;
+    brelse(bp);
+  }
+  return bn;
+}
+
+// Put (name, inum) in a free slot of leaf bn.
+// returns -1 if the leaf is full.
+static int
+dxadd(struct inode *dp, uint bn, char *name, uint inum)
+{
+  struct buf *bp;
+  struct dirent *de;
+
+  bp = dirblock(dp, bn);
+  for (de = (struct dirent *)bp->data; de < (struct dirent *)bp->data + DPB; de++)
+  {
+    if (de->inum == 0)
+    {
+      strncpy(de->name, name, DIRSIZ);
+      de->inum = inum;
+      log_write(bp);
+      brelse(bp);
+      return 0;
+    }
+  }
+  brelse(bp);
+  return -1;
+}
+
+// Where to split the full leaf in bp: a hash near the median
+// of its names' hashes, chosen so that equal hashes stay
+// together. returns 0 if all the names hash alike.
+static uint
+dxmedian(struct buf *bp)
+{
+  struct dirent *de = (struct dirent *)bp->data;
+  uint hs[DPB], h;
+  int i, j, k;
+
+  for (i = 0; i < DPB; i++)
+  {
+    h = dirhash(de[i].name);
+    for (j = i; j > 0 && hs[j - 1] > h; j--)
+      hs[j] = hs[j - 1];
+    hs[j] = h;
+  }
+  for (k = DPB / 2; k < DPB && hs[k] == hs[k - 1]; k++)
+    ;
+  if (k == DPB)
+    for (k = DPB / 2 - 1; k > 0 && hs[k] == hs[k - 1]; k--)
+      ;
+  return k > 0 ? hs[k] : 0;
+}
+
+// Split the (full) leaf that names with hash go to, first
+// splitting the index node above it if that is full, or moving
+// the root's entries down a level if the root is full.
+// returns -1 if out of disk space, or if the index is full.
+static int
+dxsplit(struct inode *dp, uint hash)
+{
+  struct buf *rbp, *pbp, *bp, *nbp;
+  struct dxhead *root, *ph, *h;
+  struct dirent *de, *nde;
+  uint bn, m;
+  int i, j;
+
+  rbp = dirblock(dp, 0);
+  root = dxnode(rbp, 1);
+  if (root->depth == 0 && root->n == NDXROOT)
+  {
+    if ((bn = dirgrow(dp)) == 0)
+      goto bad;
+    bp = dirblock(dp, bn);
+    memmove(dxnode(bp, 0), root, sizeof(*root) + root->n * sizeof(struct dxentry));
+    log_write(bp);
+    brelse(bp);
+    memset(DXENT(root), 0, root->n * sizeof(struct dxentry));
+    root->n = 0;
+    root->depth = 1;
+    dxinsert(root, 0, 0, bn);
+    log_write(rbp);
+  }
+
+  // find the node above the leaf.
+  pbp = rbp;
+  ph = root;
+  if (root->depth > 0)
+  {
+    i = dxpick(root, hash);
+    pbp = dirblock(dp, DXENT(root)[i].blk);
+    ph = dxnode(pbp, 0);
+    if (ph->n == NDXNODE)
+    {
+      // move its upper half to a new node.
+      if (root->n == NDXROOT || (bn = dirgrow(dp)) == 0)
+      {
+        brelse(pbp);
+        goto bad;
+      }
+      bp = dirblock(dp, bn);
+      h = dxnode(bp, 0);
+      j = ph->n / 2;
+      h->n = ph->n - j;
+      h->depth = ph->depth;
+      memmove(DXENT(h), DXENT(ph) + j, h->n * sizeof(struct dxentry));
+      memset(DXENT(ph) + j, 0, h->n * sizeof(struct dxentry));
+      ph->n = j;
+      dxinsert(root, i + 1, DXENT(h)->hash, bn);
+      log_write(rbp);
+      log_write(pbp);
+      log_write(bp);
+      if (hash >= DXENT(h)->hash)
+      {
+        brelse(pbp);
+        pbp = bp;
+        ph = h;
+      }
+      else
+      {
+        brelse(bp);
+      }
+    }
+    brelse(rbp);
+  }
+
+  // split the leaf, moving names with hashes >= m to a new one.
+  i = dxpick(ph, hash);
+  bp = dirblock(dp, DXENT(ph)[i].blk);
+  if ((m = dxmedian(bp)) == 0 || (bn = dirgrow(dp)) == 0)
+  {
+    brelse(bp);
+    brelse(pbp);
+    return -1;
+  }
+  nbp = dirblock(dp, bn);
+  de = (struct dirent *)bp->data;
+  nde = (struct dirent *)nbp->data;
+  for (j = 0; j < DPB; j++)
+  {
+    if (dirhash(de[j].name) >= m)
+    {
+      *nde++ = de[j];
+      memset(&de[j], 0, sizeof(de[j]));
+    }
+  }
+  dxinsert(ph, i + 1, m, bn);
+  log_write(bp);
+  log_write(nbp);
+  log_write(pbp);
+  brelse(bp);
+  brelse(nbp);
+  brelse(pbp);
+  return 0;
+
+bad:
+  brelse(rbp);
+  return -1;
+}
+
+// Convert directory dp, whose only block is full, to an
+// indexed one: its entries other than "." and ".." move to a
+// leaf, and the rest of block 0 becomes the index root.
+static int
+dxconvert(struct inode *dp)
+{
+  struct buf *bp, *lbp;
+  struct dirent *de;
+  struct dxhead *root;
+  uint bn;
+
+  if ((bn = dirgrow(dp)) == 0)
+    return -1;
+  bp = dirblock(dp, 0);
+  lbp = dirblock(dp, bn);
+  de = (struct dirent *)bp->data;
+  memmove(lbp->data, de + DXROOT, (DPB - DXROOT) * sizeof(*de));
+  memset(de + DXROOT, 0, (DPB - DXROOT) * sizeof(*de));
+  root = dxnode(bp, 1);
+  dxinsert(root, 0, 0, bn);
+  log_write(bp);
+  log_write(lbp);
+  brelse(bp);
+  brelse(lbp);
+  dp->flags |= IF_DINDEX;
+  iupdate(dp);
+  return 0;
+}
+
+// Look for name in the leaf of indexed directory dp.
+static struct inode *
+dxlookup(struct inode *dp, char *name, uint *poff)
+{
+  struct buf *bp;
+  struct dirent *de;
+  uint bn, inum;
+  int i;
+
+  bn = dxleaf(dp, dirhash(name));
+  bp = dirblock(dp, bn);
+  de = (struct dirent *)bp->data;
+  for (i = 0; i < DPB; i++)
+  {
+    if (de[i].inum != 0 && namecmp(name, de[i].name) == 0)
+    {
+      if (poff)
+        *poff = bn * BSIZE + i * sizeof(*de);
+      inum = de[i].inum;
+      brelse(bp);
+      return iget(dp->dev, inum);
+    }
+  }
+  brelse(bp);
+  return 0;
+}
+
 // Look for a directory entry in a directory.
 // If found, set *poff to byte offset of entry.
 struct inode *
 dirlookup(struct inode *dp, char *name, uint *poff)
 {
-  uint off, inum;
+  uint off, inum, end;
   struct dirent de;
+  struct inode *ip;
 
   if (dp->type != T_DIR)
     panic("dirlookup not DIR");
 
-  for (off = 0; off < dp->size; off += sizeof(de))
+  if (poff == 0 && dcache_lookup(dp->dev, dp->inum, name, &inum))
+    return inum ? iget(dp->dev, inum) : 0;
+
+  // an indexed directory has only "." and ".." outside its leaves.
+  end = dp->size;
+  if (dp->flags & IF_DINDEX)
+  {
+    if (namecmp(name, ".") != 0 && namecmp(name, "..") != 0)
+    {
+      ip = dxlookup(dp, name, poff);
+      dcache_enter(dp->dev, dp->inum, name, ip ? ip->inum : 0);
+      return ip;
+    }
+    end = DXROOT * sizeof(de);
+  }
+
+  for (off = 0; off < end; off += sizeof(de))
   {
     if (readi(dp, 0, (uint64)&de, off, sizeof(de)) != sizeof(de))
       panic("dirlookup read");
@@ -583,10 +2015,12 @@ dirlookup(struct inode *dp, char *name, uint *poff)
       if (poff)
         *poff = off;
       inum = de.inum;
+      dcache_enter(dp->dev, dp->inum, name, inum);
       return iget(dp->dev, inum);
     }
   }
 
+  dcache_enter(dp->dev, dp->inum, name, 0);
   return 0;
 }
 
@@ -595,6 +2029,7 @@ dirlookup(struct inode *dp, char *name, uint *poff)
 int dirlink(struct inode *dp, char *name, uint inum)
 {
   int off;
+  uint hash;
   struct dirent de;
   struct inode *ip;
 
@@ -605,23 +2040,87 @@ int dirlink(struct inode *dp, char *name, uint inum)
     return -1;
   }
 
-  // Look for an empty dirent.
-  for (off = 0; off < dp->size; off += sizeof(de))
+  if (!(dp->flags & IF_DINDEX))
   {
-    if (readi(dp, 0, (uint64)&de, off, sizeof(de)) != sizeof(de))
-      panic("dirlink read");
-    if (de.inum == 0)
-      break;
+    // Look for an empty dirent.
+    for (off = 0; off < dp->size; off += sizeof(de))
+    {
+      if (readi(dp, 0, (uint64)&de, off, sizeof(de)) != sizeof(de))
+        panic("dirlink read");
+      if (de.inum == 0)
+        break;
+    }
+
+    // append, unless the first block is full.
+    if (off < dp->size || off != BSIZE)
+    {
+      strncpy(de.name, name, DIRSIZ);
+      de.inum = inum;
+      if (writei(dp, 0, (uint64)&de, off, sizeof(de)) != sizeof(de))
+        return -1;
+      goto done;
+    }
+    if (dxconvert(dp) < 0)
+      return -1;
   }
 
-  strncpy(de.name, name, DIRSIZ);
-  de.inum = inum;
-  if (writei(dp, 0, (uint64)&de, off, sizeof(de)) != sizeof(de))
-    return -1;
+  hash = dirhash(name);
+  if (dxadd(dp, dxleaf(dp, hash), name, inum) < 0)
+  {
+    if (dxsplit(dp, hash) < 0)
+      return -1;
+    if (dxadd(dp, dxleaf(dp, hash), name, inum) < 0)
+      panic("dirlink: split");
+  }
 
+done:
+  dcache_enter(dp->dev, dp->inum, name, inum);
   return 0;
 }
 
+// Copy up to n entries of directory dp, from byte offset *off
+// on, to dst as struct dirstat's, advancing *off past them.
+// With stat, also copy each entry's type, nlink and size from
+// its on-disk inode, which iupdate() keeps current, so that
+// the entries need not be locked (".." could not be, while
+// dp is). Caller must hold dp's lock.
+// Returns the number of entries copied, or -1.
+int dirread(struct inode *dp, int user_dst, uint64 dst, int n, uint *off, int stat)
+{
+  struct dirent de;
+  struct dirstat ds;
+  struct dinode *dip;
+  struct buf *bp;
+  int i = 0;
+
+  if (dp->type != T_DIR)
+    return -1;
+  while (i < n && *off + sizeof(de) <= dp->size)
+  {
+    if (readi(dp, 0, (uint64)&de, *off, sizeof(de)) != sizeof(de))
+      return -1;
+    *off += sizeof(de);
+    if (de.inum == 0)
+      continue;
+    memset(&ds, 0, sizeof(ds));
+    ds.inum = de.inum;
+    memmove(ds.name, de.name, DIRSIZ);
+    if (stat)
+    {
+      bp = bread(dp->dev, IBLOCK(de.inum, sb));
+      dip = (struct dinode *)bp->data + de.inum % IPB;
+      ds.type = dip->type;
+      ds.nlink = dip->nlink;
+      ds.size = dip->size;
+      brelse(bp);
+    }
+    if (either_copyout(user_dst, dst + i * sizeof(ds), &ds, sizeof(ds)) == -1)
+      return -1;
+    i++;
+  }
+  return i;
+}
+
 // Paths
 
 // Copy the next path element from path into name.
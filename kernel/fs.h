@@ -22,23 +22,64 @@ struct superblock
   uint bmapstart;  // Block number of first free map block
 };
 
-#define FSMAGIC 0x10203040
+// changes whenever the on-disk format does, so that the kernel
+// rejects images made by an older mkfs.
+#define FSMAGIC 0x10203041
 
-#define NDIRECT 12
+// a block-mapped inode's addrs[]: NDIRECT direct blocks, then
+// a singly-, a doubly- and a triply-indirect block.
+#define NDIRECT 10
 #define NINDIRECT (BSIZE / sizeof(uint))
-#define MAXFILE (NDIRECT + NINDIRECT)
+#define NDINDIRECT (NINDIRECT * NINDIRECT)
+#define NTINDIRECT (NINDIRECT * NINDIRECT * NINDIRECT)
+#define NADDRS (NDIRECT + 3)
+#define MAXFILE (NDIRECT + NINDIRECT + NDINDIRECT + NTINDIRECT)
 
 // On-disk inode structure
 struct dinode
 {
-  short type;              // File type
-  short major;             // Major device number (T_DEVICE only)
-  short minor;             // Minor device number (T_DEVICE only)
-  short nlink;             // Number of links to inode in file system
-  uint size;               // Size of file (bytes)
-  uint addrs[NDIRECT + 1]; // Data block addresses
+  uchar type;         // File type
+  uchar flags;        // IF_* flags
+  short major;        // Major device number (T_DEVICE only)
+  short minor;        // Minor device number (T_DEVICE only)
+  short nlink;        // Number of links to inode in file system
+  uint size;          // Size of file (bytes)
+  uint addrs[NADDRS]; // Data block addresses
 };
 
+// dinode flags
+#define IF_EXTENT 0x1 // addrs[] holds an extent tree, not block addresses
+#define IF_INLINE 0x2 // addrs[] holds the file's data (at most NINLINE bytes)
+#define IF_DINDEX 0x4 // directory with a hash index (see below)
+#define IF_ORPHAN 0x8 // unlinked; its blocks are being freed in the background
+
+// bytes of data an inline file can hold.
+#define NINLINE (sizeof(uint) * NADDRS)
+
+// An extent-mapped inode keeps a tree of extents in addrs[]
+// instead of block addresses. A node is a header followed by
+// entries sorted by lblk: the root in addrs[], the rest in
+// blocks of their own. In a leaf (depth 0) an entry maps the
+// len file blocks starting at lblk to the disk blocks starting
+// at start; in an interior node, an entry points to the child
+// node in disk block start that maps lblk onward.
+struct xheader
+{
+  ushort n;     // entries in use
+  ushort depth; // 0 for a leaf
+};
+
+struct xentry
+{
+  uint lblk;  // first file block
+  uint start; // first disk block, or child node's block
+  uint len;   // blocks (leaf only)
+};
+
+// entries in the root (in addrs[]) and in a tree block.
+#define NXROOT ((sizeof(uint) * NADDRS - sizeof(struct xheader)) / sizeof(struct xentry))
+#define NXBLOCK ((BSIZE - sizeof(struct xheader)) / sizeof(struct xentry))
+
 // Inodes per block.
 #define IPB (BSIZE / sizeof(struct dinode))
 
@@ -59,3 +100,45 @@ struct dirent
   ushort inum;
   char name[DIRSIZ];
 };
+
+// A directory entry as getdents() returns it. type, nlink and
+// size are copied from the entry's inode if getdents() was
+// asked to (GD_STAT), and are 0 otherwise.
+struct dirstat
+{
+  uint inum;
+  short type;
+  short nlink;
+  uint size;
+  char name[DIRSIZ + 1]; // null-terminated
+};
+
+// Dirents per block.
+#define DPB (BSIZE / sizeof(struct dirent))
+
+// An indexed directory keeps "." and ".." in the first two
+// slots of block 0, followed by the root of an index of name
+// hashes; the other entries live in leaf blocks, each holding
+// the names whose hashes fall in one range. An index node is a
+// dxhead and then dxentry's sorted by hash, one per 16-byte
+// slot; both start with a zero inum, so they read as empty
+// dirents.
+struct dxhead
+{
+  uint zero;
+  ushort n;     // entries that follow
+  ushort depth; // 0: entries point at leaves; 1: at index nodes
+  uint unused[2];
+};
+
+struct dxentry
+{
+  uint zero;
+  uint hash; // lowest name hash under blk
+  uint blk;  // directory block (not disk block) of the child
+  uint unused;
+};
+
+#define DXROOT 2                   // slot of the root's dxhead in block 0
+#define NDXROOT (DPB - DXROOT - 1) // entries in the root
+#define NDXNODE (DPB - 1)          // entries in an index node
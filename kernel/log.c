@@ -10,48 +10,112 @@
 // Simple logging that allows concurrent FS system calls.
 //
 // A log transaction contains the updates of multiple FS system
-// calls. The logging system only commits when there are
-// no FS system calls active. Thus there is never
-// any reasoning required about whether a commit might
-// write an uncommitted system call's updates to disk.
+// calls. A transaction is only closed when there are no FS
+// system calls active in it. Thus there is never any reasoning
+// required about whether a commit might write an uncommitted
+// system call's updates to disk.
 //
 // A system call should call begin_op()/end_op() to mark
 // its start and end. Usually begin_op() just increments
-// the count of in-progress FS system calls and returns.
+// the count of in-progress FS system calls, reserves
+// MAXOPBLOCKS of log space for the call, and returns.
 // But if it thinks the log is close to running out, it
-// sleeps until the last outstanding end_op() commits.
+// sleeps until the logger has closed the open transaction.
+// Calls that write more, such as big write()s, reserve
+// space in proportion with begin_opn()/end_opn().
+//
+// The size of the on-disk log is chosen by mkfs and recorded
+// in the superblock; a transaction holds at most
+// min(sb.nlog - 2, LOGSIZE) blocks.
+//
+// Transactions are double-buffered. The logger kernel thread
+// closes the open transaction once its last system call has
+// finished, by copying ("freezing") the transaction's blocks
+// out of the buffer cache. New system calls then start the
+// next transaction while the logger writes the frozen one to
+// disk, so end_op() never waits for a commit. System calls
+// that need their updates to be durable call log_sync().
+//
+// Committed blocks are not written to their home locations
+// right away. The log holds a run of committed transactions,
+// and the logger keeps the latest committed copy of each of
+// their blocks, pinned in the cache, until the log is full.
+// Then it checkpoints: writes each block home once, however
+// many transactions changed it, and starts the log over.
 //
 // The log is a physical re-do log containing disk blocks.
 // The on-disk log format:
-//   header block, containing block #s for block A, B, C, ...
+//   anchor block, containing the number of the first transaction
+//   header block, containing a checksum and block #s for A, B, C, ...
 //   block A
 //   block B
 //   block C
+//   header block of the next transaction
 //   ...
-// Log appends are synchronous.
+// The checksum covers the header and the logged blocks, so
+// commit() can write the blocks and the header as one batch
+// in any order: if a crash leaves the log torn, the checksum
+// won't match and recovery stops there. Transaction numbers
+// must follow on from the anchor's, which stops recovery at
+// whatever a checkpoint left behind from the previous run.
 
 // Contents of the header block, used for both the on-disk header block
 // and to keep track in memory of logged block# before commit.
 struct logheader
 {
   int n;
+  uint seq; // transaction number
+  uint sum; // log_cksum() of the transaction
   int block[LOGSIZE];
 };
 
+// Contents of the anchor block.
+struct loganchor
+{
+  uint seq; // number of the first transaction in the log
+};
+
 struct log
 {
   struct spinlock lock;
   int start;
   int size;
+  int cap;         // max blocks in a transaction.
   int outstanding; // how many FS sys calls are executing.
-  int committing;  // in commit(), please wait.
+  int reserved;    // log blocks reserved by executing FS sys calls.
+  int freezing;    // logger is closing the open transaction, please wait.
   int dev;
-  struct logheader lh;
+  uint seq;             // number of the open transaction.
+  uint done;            // transactions up to this one are on disk.
+  uint want;            // log_sync() wants this transaction closed.
+  struct logheader lh;  // the open transaction.
+  struct logheader clh; // the closed transaction being committed.
+  int tail;             // where in the log the next transaction goes.
+
+  // blocks committed since the last checkpoint: home block #,
+  // the pinned cache buffer, and the latest committed contents.
+  int nckpt;
+  uint home[LOGSIZE];
+  struct buf *cbuf[LOGSIZE];
+  struct buf copy[LOGSIZE];
+  int cslot[LOGSIZE]; // clh.block[i] is in copy[cslot[i]].
+
+  struct buf head;                // private copy of a header or anchor.
+  struct buf *batch[LOGSIZE + 1]; // for bwritev_uncached().
+
+  // counters, reported via the statistics device.
+  struct
+  {
+    uint64 commits;
+    uint64 logged;      // blocks written to the log
+    uint64 checkpoints;
+    uint64 installed;   // blocks written home
+  } st;
 };
 struct log log;
 
 static void recover_from_log(void);
-static void commit();
+static void logger(void);
 
 void initlog(int dev, struct superblock *sb)
 {
@@ -61,109 +125,190 @@ void initlog(int dev, struct superblock *sb)
   initlock(&log.lock, "log");
   log.start = sb->logstart;
   log.size = sb->nlog;
+  // the anchor, and one transaction's header and blocks.
+  log.cap = log.size - 2;
+  if (log.cap > LOGSIZE)
+    log.cap = LOGSIZE;
+  if (log.cap < MAXOPBLOCKS)
+    panic("initlog: log too small");
   log.dev = dev;
+  for (int i = 0; i < LOGSIZE; i++)
+    log.copy[i].dev = dev;
+  log.head.dev = dev;
   recover_from_log();
+  kthread(logger, "logger");
 }
 
-// Copy committed blocks from log to their home location
-static void
-install_trans(int recovering)
+// Checksum of a transaction: the header's n, seq, and block
+// numbers, and the contents of its n blocks (in bs[]).
+// 32-bit FNV-1a over words; it only has to catch torn logs.
+static uint
+log_cksum(struct logheader *lh, struct buf **bs)
 {
-  int tail;
+  uint h = 2166136261;
 
-  for (tail = 0; tail < log.lh.n; tail++)
+#define MIX(w) (h = (h ^ (uint)(w)) * 16777619)
+  MIX(lh->n);
+  MIX(lh->seq);
+  for (int i = 0; i < lh->n; i++)
   {
-    struct buf *lbuf = bread(log.dev, log.start + tail + 1); // read log block
-    struct buf *dbuf = bread(log.dev, log.lh.block[tail]);   // read dst
-    memmove(dbuf->data, lbuf->data, BSIZE);                  // copy block to dst
-    bwrite(dbuf);                                            // write dst to disk
-    if (recovering == 0)
-      bunpin(dbuf);
-    brelse(lbuf);
-    brelse(dbuf);
+    uint *w = (uint *)bs[i]->data;
+    MIX(lh->block[i]);
+    for (int j = 0; j < BSIZE / sizeof(uint); j++)
+      MIX(w[j]);
   }
+#undef MIX
+  return h;
 }
 
-// Read the log header from disk into the in-memory log header
+// Write the anchor block, naming seq as the first transaction
+// in the log. Waits for the write.
 static void
-read_head(void)
+write_anchor(uint seq)
 {
-  struct buf *buf = bread(log.dev, log.start);
-  struct logheader *lh = (struct logheader *)(buf->data);
-  int i;
-  log.lh.n = lh->n;
-  for (i = 0; i < log.lh.n; i++)
-  {
-    log.lh.block[i] = lh->block[i];
-  }
-  brelse(buf);
+  struct loganchor *a = (struct loganchor *)(log.head.data);
+
+  memset(log.head.data, 0, BSIZE);
+  a->seq = seq;
+  log.head.blockno = log.start;
+  bwrite_uncached(&log.head);
 }
 
-// Write in-memory log header to disk.
-// This is the true point at which the
-// current transaction commits.
-static void
-write_head(void)
+// Read the header of the transaction at log position pos into
+// log.clh, and check it against the logged blocks, which are
+// left in log.batch[0..n). Returns 0, with nothing held, if
+// there is no complete transaction seq at pos.
+static int
+read_head(int pos, uint seq)
 {
-  struct buf *buf = bread(log.dev, log.start);
-  struct logheader *hb = (struct logheader *)(buf->data);
-  int i;
-  hb->n = log.lh.n;
-  for (i = 0; i < log.lh.n; i++)
+  struct buf *buf;
+  struct logheader *lh;
+  int i, ok;
+
+  if (pos + 1 > log.size - 1)
+    return 0;
+  buf = bread(log.dev, log.start + 1 + pos);
+  lh = (struct logheader *)(buf->data);
+  log.clh.n = lh->n;
+  log.clh.seq = lh->seq;
+  log.clh.sum = lh->sum;
+  if (log.clh.seq != seq || log.clh.n <= 0 || log.clh.n > log.cap ||
+      pos + 1 + log.clh.n > log.size - 1)
+  {
+    brelse(buf);
+    return 0;
+  }
+  for (i = 0; i < log.clh.n; i++)
   {
-    hb->block[i] = log.lh.block[i];
+    log.clh.block[i] = lh->block[i];
   }
-  bwrite(buf);
   brelse(buf);
+
+  for (i = 0; i < log.clh.n; i++)
+    log.batch[i] = bread(log.dev, log.start + 1 + pos + 1 + i);
+  ok = log_cksum(&log.clh, log.batch) == log.clh.sum;
+  if (!ok)
+  {
+    for (i = 0; i < log.clh.n; i++)
+      brelse(log.batch[i]);
+    printf("log: ignoring torn transaction %d\n", log.clh.seq);
+  }
+  return ok;
 }
 
+// Replay each complete transaction in the log, in order,
+// then start the log over.
 static void
 recover_from_log(void)
 {
-  read_head();
-  install_trans(1); // if committed, copy from log to disk
-  log.lh.n = 0;
-  write_head(); // clear the log
+  struct buf *buf = bread(log.dev, log.start);
+  uint seq = ((struct loganchor *)(buf->data))->seq;
+  int pos = 0;
+
+  brelse(buf);
+  if (seq == 0) // fresh from mkfs
+    seq = 1;
+
+  while (read_head(pos, seq))
+  {
+    // copy committed blocks from log to their home location
+    for (int i = 0; i < log.clh.n; i++)
+    {
+      struct buf *lbuf = log.batch[i];
+      struct buf *dbuf = bread(log.dev, log.clh.block[i]); // read dst
+      memmove(dbuf->data, lbuf->data, BSIZE);              // copy block to dst
+      bwrite(dbuf);                                        // write dst to disk
+      brelse(lbuf);
+      brelse(dbuf);
+    }
+    pos += 1 + log.clh.n;
+    seq += 1;
+  }
+  log.clh.n = 0;
+
+  write_anchor(seq); // clear the log
+  log.seq = seq;
+  log.done = seq - 1;
+  log.tail = 0;
 }
 
-// called at the start of each FS system call.
-void begin_op(void)
+// called at the start of an FS system call that may
+// write up to n blocks. n must be at most log_maxop().
+void begin_opn(int n)
 {
+  if (n > log_maxop())
+    panic("begin_opn");
+
   acquire(&log.lock);
   while (1)
   {
-    if (log.committing)
+    if (log.freezing)
     {
       sleep(&log, &log.lock);
     }
-    else if (log.lh.n + (log.outstanding + 1) * MAXOPBLOCKS > LOGSIZE)
+    else if (log.lh.n + log.reserved + n > log.cap)
     {
-      // this op might exhaust log space; wait for commit.
+      // this op might exhaust log space; wait for the
+      // logger to close the open transaction.
       sleep(&log, &log.lock);
     }
     else
     {
       log.outstanding += 1;
+      log.reserved += n;
       release(&log.lock);
       break;
     }
   }
 }
 
-// called at the end of each FS system call.
-// commits if this was the last outstanding operation.
-void end_op(void)
+// called at the start of each FS system call.
+void begin_op(void)
 {
-  int do_commit = 0;
+  begin_opn(MAXOPBLOCKS);
+}
 
+// the most blocks a single FS system call may reserve:
+// half the log, so that other calls can share a transaction.
+int log_maxop(void)
+{
+  if (log.cap / 2 < MAXOPBLOCKS)
+    return MAXOPBLOCKS;
+  return log.cap / 2;
+}
+
+// called at the end of each FS system call that began
+// with begin_opn(n), with the same n.
+// if this was the last outstanding operation, the logger
+// can close the transaction; end_opn() doesn't wait for that.
+void end_opn(int n)
+{
   acquire(&log.lock);
   log.outstanding -= 1;
-  if (log.committing)
-    panic("log.committing");
+  log.reserved -= n;
   if (log.outstanding == 0)
   {
-    do_commit = 1;
-    log.committing = 1;
+    wakeup(&log.outstanding);
   }
   else
   {
@@ -173,52 +318,206 @@ void end_op(void)
     wakeup(&log);
   }
   release(&log.lock);
+}
 
-  if (do_commit)
+// called at the end of each FS system call.
+void end_op(void)
+{
+  end_opn(MAXOPBLOCKS);
+}
+
+// Wait until every FS system call that has finished so far
+// is on disk. Must not be called inside a transaction.
+void log_sync(void)
+{
+  uint target;
+
+  acquire(&log.lock);
+  if (log.lh.n > 0 || log.outstanding > 0)
   {
-    // call commit w/o holding locks, since not allowed
-    // to sleep with locks.
-    commit();
-    acquire(&log.lock);
-    log.committing = 0;
-    wakeup(&log);
-    release(&log.lock);
+    // the open transaction has (or may get) updates.
+    target = log.seq;
+    log.want = target;
+    wakeup(&log.outstanding);
+  }
+  else
+  {
+    target = log.seq - 1;
+  }
+  while (log.done < target)
+    sleep(&log.done, &log.lock);
+  release(&log.lock);
+}
+
+// Write the latest committed copy of every block in the log
+// to its home location, once, then start the log over.
+// The anchor is written last: until then, recovery would
+// replay the whole log.
+static void
+checkpoint(void)
+{
+  int i;
+
+  if (log.nckpt == 0)
+    return;
+  for (i = 0; i < log.nckpt; i++)
+  {
+    log.copy[i].blockno = log.home[i];
+    log.batch[i] = &log.copy[i];
+  }
+  bwritev_uncached(log.batch, log.nckpt);
+  for (i = 0; i < log.nckpt; i++)
+    bunpin(log.cbuf[i]);
+  log.st.checkpoints += 1;
+  log.st.installed += log.nckpt;
+  log.nckpt = 0;
+
+  write_anchor(log.seq);
+  log.tail = 0;
+}
+
+// Copy the open transaction's blocks out of the cache,
+// so that later system calls can modify the cached copies.
+// begin_op() is held off meanwhile, so no one is changing them.
+// A block already in the log since the last checkpoint keeps
+// its copy slot (and cache pin), and the copy is updated.
+static void
+freeze(void)
+{
+  int tail, i;
+
+  for (tail = 0; tail < log.lh.n; tail++)
+  {
+    struct buf *b = bread(log.dev, log.lh.block[tail]); // pinned, so cached
+    for (i = 0; i < log.nckpt; i++)
+    {
+      if (log.home[i] == log.lh.block[tail])
+        break;
+    }
+    if (i == log.nckpt)
+    {
+      log.home[i] = log.lh.block[tail];
+      log.cbuf[i] = b;
+      log.nckpt++;
+    }
+    else
+    {
+      bunpin(b); // copy slot i already holds a pin
+    }
+    memmove(log.copy[i].data, b->data, BSIZE);
+    log.cslot[tail] = i;
+    brelse(b);
   }
 }
 
-// Copy modified blocks from cache to log.
+// Write frozen blocks to the log, and the header with them,
+// as one batch. There is no need to wait for the blocks before
+// writing the header: recovery checks the checksum. This is
+// the true point at which the transaction commits.
 static void
 write_log(void)
 {
+  struct logheader *hb = (struct logheader *)(log.head.data);
   int tail;
 
-  for (tail = 0; tail < log.lh.n; tail++)
+  for (tail = 0; tail < log.clh.n; tail++)
+  {
+    struct buf *b = &log.copy[log.cslot[tail]];
+    b->blockno = log.start + 1 + log.tail + 1 + tail;
+    log.batch[tail] = b;
+  }
+  log.clh.sum = log_cksum(&log.clh, log.batch);
+
+  memset(log.head.data, 0, BSIZE);
+  hb->n = log.clh.n;
+  hb->seq = log.clh.seq;
+  hb->sum = log.clh.sum;
+  for (tail = 0; tail < log.clh.n; tail++)
   {
-    struct buf *to = bread(log.dev, log.start + tail + 1); // log block
-    struct buf *from = bread(log.dev, log.lh.block[tail]); // cache block
-    memmove(to->data, from->data, BSIZE);
-    bwrite(to); // write the log
-    brelse(from);
-    brelse(to);
+    hb->block[tail] = log.clh.block[tail];
   }
+  log.head.blockno = log.start + 1 + log.tail;
+  log.batch[log.clh.n] = &log.head;
+  bwritev_uncached(log.batch, log.clh.n + 1);
 }
 
 static void
 commit()
 {
-  if (log.lh.n > 0)
+  if (log.clh.n > 0)
+  {
+    write_log(); // Write frozen blocks and header -- the real commit
+    log.tail += 1 + log.clh.n;
+    log.st.commits += 1;
+    log.st.logged += log.clh.n;
+    log.clh.n = 0;
+  }
+}
+
+// The logger kernel thread. Closes the open transaction once
+// no FS system calls are executing in it, then commits it
+// while the next transaction fills up.
+static void
+logger(void)
+{
+  acquire(&log.lock);
+  for (;;)
   {
-    write_log();      // Write modified blocks from cache to log
-    write_head();     // Write header to disk -- the real commit
-    install_trans(0); // Now install writes to home locations
+    while (log.outstanding > 0 || (log.lh.n == 0 && log.want != log.seq))
+      sleep(&log.outstanding, &log.lock);
+
+    log.freezing = 1;
+    release(&log.lock);
+
+    // make room first if the transaction won't fit in the
+    // log, or its blocks might not fit in the copy slots.
+    // freeze() overwrites copies, so this can't wait.
+    if (log.tail + 1 + log.lh.n > log.size - 1 ||
+        log.nckpt + log.lh.n > LOGSIZE)
+      checkpoint();
+
+    freeze();
+
+    acquire(&log.lock);
+    log.clh = log.lh;
+    log.clh.seq = log.seq;
     log.lh.n = 0;
-    write_head(); // Erase the transaction from the log
+    log.seq += 1;
+    log.freezing = 0;
+    wakeup(&log);
+    release(&log.lock);
+
+    // call commit w/o holding locks, since not allowed
+    // to sleep with locks.
+    commit();
+
+    acquire(&log.lock);
+    log.done = log.seq - 1;
+    wakeup(&log.done);
   }
 }
 
+// format the log counters into buf, for the statistics device.
+// returns the number of bytes written.
+int log_stats(char *buf, int sz)
+{
+  int n = 0;
+
+  acquire(&log.lock);
+  n += snprintf(buf + n, sz - n,
+                "log: size %d commits %lu logged %lu pending %d\n",
+                log.size, log.st.commits, log.st.logged, log.nckpt);
+  n += snprintf(buf + n, sz - n,
+                "log: checkpoints %lu installed %lu absorbed %lu\n",
+                log.st.checkpoints, log.st.installed,
+                log.st.logged - log.st.installed - log.nckpt);
+  release(&log.lock);
+  return n;
+}
+
 // Caller has modified b->data and is done with the buffer.
 // Record the block number and pin in the cache by increasing refcnt.
-// commit()/write_log() will do the disk write.
+// The logger's commit() will do the disk write.
 //
 // log_write() replaces bwrite(); a typical use is:
 //   bp = bread(...)
@@ -230,7 +529,7 @@ void log_write(struct buf *b)
   int i;
 
   acquire(&log.lock);
-  if (log.lh.n >= LOGSIZE || log.lh.n >= log.size - 1)
+  if (log.lh.n >= log.cap)
     panic("too big a transaction");
   if (log.outstanding < 1)
     panic("log_write outside of trans");
@@ -26,7 +26,11 @@ void main()
     plicinithart();     // ask PLIC for device interrupts
     binit();            // buffer cache
     iinit();            // inode table
+    dcacheinit();       // directory entry cache
     fileinit();         // file table
+    pollinit();         // poll() wait queue
+    epollinit();        // epoll instances
+    statsinit();        // statistics device
     virtio_disk_init(); // emulated hard disk
     userinit();         // first user process
     __sync_synchronize();
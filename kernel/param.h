@@ -6,13 +6,16 @@
 #define NCPU 8                    // maximum number of CPUs
 #define NOFILE 16                 // open files per process
 #define NFILE 100                 // open files per system
-#define NINODE 50                 // maximum number of active i-nodes
+#define NINODE 50                 // unreferenced i-nodes kept cached
 #define NDEV 10                   // maximum major device number
+#define NEPOLL 16                 // epoll instances per system
+#define NEPITEM 256               // files watched by all epoll instances
+#define NEPEVENT 32               // most events one epoll_wait() returns
 #define ROOTDEV 1                 // device number of file system root disk
 #define MAXARG 32                 // max exec arguments
 #define MAXOPBLOCKS 10            // max # of blocks any FS op writes
-#define LOGSIZE (MAXOPBLOCKS * 3) // max data blocks in on-disk log
-#define NBUF (MAXOPBLOCKS * 3)    // size of disk block cache
+#define LOGSIZE 250               // max data blocks in on-disk log
+#define NBUF (LOGSIZE * 2 + MAXOPBLOCKS) // size of disk block cache
 #ifdef LAB_FS
 #define FSSIZE 200000 // size of file system in blocks
 #else
@@ -23,6 +26,7 @@
 #endif
 #endif
 #define MAXPATH 128 // maximum file path name
+#define DISKPOLL 0  // 1: spin for disk completions instead of sleeping
 
 #ifdef LAB_UTIL
 #define USERSTACK 2 // user stack pages
@@ -7,19 +7,109 @@
 #include "fs.h"
 #include "sleeplock.h"
 #include "file.h"
+#include "fcntl.h"
 
-#define PIPESIZE 512
+#define PIPESIZE PGSIZE      // default buffer size
+#define PIPEMIN 512           // smallest buffer
+#define PIPEMAX (16 * PGSIZE) // largest buffer
+#define NPIPEPAGE (PIPEMAX / PGSIZE)
+
+#define min(a, b) ((a) < (b) ? (a) : (b))
 
 struct pipe
 {
   struct spinlock lock;
-  char data[PIPESIZE];
+  char *page[NPIPEPAGE]; // the buffer, in PGSIZE pieces
+  uint size;     // bytes in the buffer; a power of two
   uint nread;    // number of bytes read
   uint nwrite;   // number of bytes written
   int readopen;  // read fd is still open
   int writeopen; // write fd is still open
+  int rsleep;    // a reader is waiting for data
+  uint wwant;    // room a waiting writer needs; 0 if none waits
+  struct epitem *watch; // epoll items watching the pipe
 };
 
+// pages needed for a buffer of size bytes.
+static int
+pipepages(uint size)
+{
+  return (size + PGSIZE - 1) / PGSIZE;
+}
+
+// Allocate the pages of a size-byte buffer into page[].
+static int
+pipebuf(char **page, uint size)
+{
+  int i;
+
+  for (i = 0; i < pipepages(size); i++)
+  {
+    if ((page[i] = kalloc()) == 0)
+    {
+      while (--i >= 0)
+        kfree(page[i]);
+      return -1;
+    }
+  }
+  return 0;
+}
+
+static void
+pipebuffree(char **page, uint size)
+{
+  int i;
+
+  for (i = 0; i < pipepages(size); i++)
+    kfree(page[i]);
+}
+
+// Where byte number off of the stream sits in the buffer.
+// Lowers *m to what is contiguous there: up to the end of
+// the page, and of the ring.
+static char *
+pipeptr(struct pipe *pi, uint off, uint *m)
+{
+  off %= pi->size;
+  *m = min(*m, pi->size - off);
+  *m = min(*m, PGSIZE - off % PGSIZE);
+  return pi->page[off / PGSIZE] + off % PGSIZE;
+}
+
+// the events ready on the read end, or on the write end
+// if writable. the caller holds pi->lock.
+static int
+pipemask(struct pipe *pi, int writable)
+{
+  int r = 0;
+
+  if (!writable)
+  {
+    if (pi->nread != pi->nwrite)
+      r |= POLLIN;
+    if (pi->writeopen == 0)
+      r |= POLLHUP;
+  }
+  else
+  {
+    if (pi->readopen == 0)
+      r |= POLLERR;
+    else if (pi->nwrite - pi->nread < pi->size)
+      r |= POLLOUT;
+  }
+  return r;
+}
+
+// the pipe has changed; tell processes in poll(),
+// and epoll items watching it. the caller holds
+// pi->lock.
+static void
+pipenotify(struct pipe *pi)
+{
+  pollwakeup();
+  epollwakeup(&pi->watch, pipemask(pi, 0), pipemask(pi, 1));
+}
+
 int pipealloc(struct file **f0, struct file **f1)
 {
   struct pipe *pi;
@@ -30,10 +120,20 @@ int pipealloc(struct file **f0, struct file **f1)
     goto bad;
   if ((pi = (struct pipe *)kalloc()) == 0)
     goto bad;
+  if (pipebuf(pi->page, PIPESIZE) < 0)
+  {
+    kfree((char *)pi);
+    pi = 0;
+    goto bad;
+  }
+  pi->size = PIPESIZE;
   pi->readopen = 1;
   pi->writeopen = 1;
   pi->nwrite = 0;
   pi->nread = 0;
+  pi->rsleep = 0;
+  pi->wwant = 0;
+  pi->watch = 0;
   initlock(&pi->lock, "pipe");
   (*f0)->type = FD_PIPE;
   (*f0)->readable = 1;
@@ -68,20 +168,106 @@ void pipeclose(struct pipe *pi, int writable)
     pi->readopen = 0;
     wakeup(&pi->nwrite);
   }
+  pipenotify(pi);
   if (pi->readopen == 0 && pi->writeopen == 0)
   {
     release(&pi->lock);
+    pipebuffree(pi->page, pi->size);
     kfree((char *)pi);
   }
   else
     release(&pi->lock);
 }
 
-int pipewrite(struct pipe *pi, uint64 addr, int n)
+int pipegetsize(struct pipe *pi)
 {
-  int i = 0;
+  return pi->size;
+}
+
+// How many bytes can be written to the pipe without waiting.
+// If the reader has gone, as many as PIPEMAX, so that the
+// write goes ahead and fails.
+int pipespace(struct pipe *pi)
+{
+  int r;
+
+  acquire(&pi->lock);
+  r = pi->readopen ? pi->size - (pi->nwrite - pi->nread) : PIPEMAX;
+  release(&pi->lock);
+  return r;
+}
+
+// Give the pipe a buffer of n bytes, rounded up to a power of
+// two, keeping what is buffered. Returns the new size, or -1
+// if n is too big or what is buffered would not fit.
+int pipesetsize(struct pipe *pi, int n)
+{
+  char *page[NPIPEPAGE], *old[NPIPEPAGE];
+  uint size, oldsize, len, off, m;
+  char *src;
+  int i;
+
+  if (n <= 0 || n > PIPEMAX)
+    return -1;
+  for (size = PIPEMIN; size < n; size *= 2)
+    ;
+  if (pipebuf(page, size) < 0)
+    return -1;
+
+  acquire(&pi->lock);
+  len = pi->nwrite - pi->nread;
+  if (len > size)
+  {
+    release(&pi->lock);
+    pipebuffree(page, size);
+    return -1;
+  }
+  // move what is buffered to the start of the new buffer.
+  for (off = 0; off < len; off += m)
+  {
+    m = min(len - off, PGSIZE - off % PGSIZE);
+    src = pipeptr(pi, pi->nread + off, &m);
+    memmove(page[off / PGSIZE] + off % PGSIZE, src, m);
+  }
+  for (i = 0; i < NPIPEPAGE; i++)
+  {
+    old[i] = pi->page[i];
+    pi->page[i] = page[i];
+  }
+  oldsize = pi->size;
+  pi->size = size;
+  pi->nread = 0;
+  pi->nwrite = len;
+  // a waiting writer may have more room, or need less.
+  pi->wwant = 0;
+  wakeup(&pi->nwrite);
+  pipenotify(pi);
+  release(&pi->lock);
+
+  pipebuffree(old, oldsize);
+  return size;
+}
+
+// Wakeups are batched: a waiting reader is woken once half the
+// buffer is full, when the writer blocks, or when the write
+// is done, rather than for every chunk; a waiting writer once
+// there is room for what it has left to write, or half the
+// buffer.
+//
+// Writes the cnt buffers of iov, in order, holding the lock
+// throughout except while waiting for room. If nonblock, writes
+// what fits instead, and returns -EAGAIN if nothing does.
+int pipewritev(struct pipe *pi, int user_src, struct iovec *iov, int cnt, int nonblock)
+{
+  int i = 0, n = 0, k;
+  uint j = 0, m, w;
+  char *p;
   struct proc *pr = myproc();
 
+  for (k = 0; k < cnt; k++)
+    n += iov[k].iov_len;
+  k = 0;
+
   acquire(&pi->lock);
   while (i < n)
   {
@@ -90,31 +276,73 @@ int pipewrite(struct pipe *pi, uint64 addr, int n)
       release(&pi->lock);
       return -1;
     }
-    if (pi->nwrite == pi->nread + PIPESIZE)
+    if (pi->nwrite == pi->nread + pi->size)
     { // DOC: pipewrite-full
-      wakeup(&pi->nread);
+      if (nonblock)
+      {
+        if (i == 0)
+          i = -EAGAIN;
+        break;
+      }
+      if (pi->rsleep)
+      {
+        pi->rsleep = 0;
+        wakeup(&pi->nread);
+      }
+      w = min(n - i, pi->size / 2);
+      if (pi->wwant == 0 || w < pi->wwant)
+        pi->wwant = w;
+      pipenotify(pi);
       sleep(&pi->nwrite, &pi->lock);
     }
     else
     {
-      char ch;
-      if (copyin(pr->pagetable, &ch, addr + i, 1) == -1)
+      while (j == iov[k].iov_len)
+      {
+        k++;
+        j = 0;
+      }
+      // copy as much as there is room for, up to the end of
+      // a page or the point where the ring wraps, in one go.
+      m = min(iov[k].iov_len - j, pi->size - (pi->nwrite - pi->nread));
+      p = pipeptr(pi, pi->nwrite, &m);
+      if (either_copyin(p, user_src, (uint64)iov[k].iov_base + j, m) == -1)
         break;
-      pi->data[pi->nwrite++ % PIPESIZE] = ch;
-      i++;
+      pi->nwrite += m;
+      i += m;
+      j += m;
+      if (pi->rsleep && pi->nwrite - pi->nread >= pi->size / 2)
+      {
+        pi->rsleep = 0;
+        wakeup(&pi->nread);
+      }
     }
   }
-  wakeup(&pi->nread);
+  if (pi->rsleep)
+  {
+    pi->rsleep = 0;
+    wakeup(&pi->nread);
+  }
+  if (i > 0)
+    pipenotify(pi);
   release(&pi->lock);
 
   return i;
 }
 
-int piperead(struct pipe *pi, uint64 addr, int n)
+// Reads into the cnt buffers of iov, in order, as much as the
+// pipe holds, once there is something to read. If nonblock,
+// returns -EAGAIN rather than wait for something.
+int pipereadv(struct pipe *pi, int user_dst, struct iovec *iov, int cnt, int nonblock)
 {
-  int i;
+  int i = 0, n = 0, k;
+  uint j = 0, m;
+  char *p;
   struct proc *pr = myproc();
-  char ch;
+
+  for (k = 0; k < cnt; k++)
+    n += iov[k].iov_len;
+  k = 0;
 
   acquire(&pi->lock);
   while (pi->nread == pi->nwrite && pi->writeopen)
@@ -124,17 +352,55 @@ int piperead(struct pipe *pi, uint64 addr, int n)
       release(&pi->lock);
       return -1;
     }
+    if (nonblock)
+    {
+      release(&pi->lock);
+      return -EAGAIN;
+    }
+    pi->rsleep = 1;
     sleep(&pi->nread, &pi->lock); // DOC: piperead-sleep
   }
-  for (i = 0; i < n; i++)
+  while (i < n && pi->nread != pi->nwrite)
   { // DOC: piperead-copy
-    if (pi->nread == pi->nwrite)
-      break;
-    ch = pi->data[pi->nread++ % PIPESIZE];
-    if (copyout(pr->pagetable, addr + i, &ch, 1) == -1)
+    while (j == iov[k].iov_len)
+    {
+      k++;
+      j = 0;
+    }
+    m = min(iov[k].iov_len - j, pi->nwrite - pi->nread);
+    p = pipeptr(pi, pi->nread, &m);
+    if (either_copyout(user_dst, (uint64)iov[k].iov_base + j, p, m) == -1)
       break;
+    pi->nread += m;
+    i += m;
+    j += m;
   }
-  wakeup(&pi->nwrite); // DOC: piperead-wakeup
+  if (pi->wwant && pi->size - (pi->nwrite - pi->nread) >= pi->wwant)
+  { // DOC: piperead-wakeup
+    pi->wwant = 0;
+    wakeup(&pi->nwrite);
+  }
+  if (i > 0)
+    pipenotify(pi);
   release(&pi->lock);
   return i;
 }
+
+// poll() events ready on the pipe's read end, or
+// on its write end if writable.
+int pipepoll(struct pipe *pi, int writable)
+{
+  int r;
+
+  acquire(&pi->lock);
+  r = pipemask(pi, writable);
+  release(&pi->lock);
+  return r;
+}
+
+// epoll items for the pipe are linked here.
+struct epitem **
+pipewatch(struct pipe *pi)
+{
+  return &pi->watch;
+}
@@ -0,0 +1,126 @@
+//
+// Waiting on several files at once, with poll().
+//
+// A process in poll() checks each of its files and, if none
+// is ready, sleeps until something happens that might make
+// one ready: pipe.c and console.c call pollwakeup() whenever
+// a pipe or the console input changes, and clockintr() calls
+// polltick() so that timeouts run out. Each such event wakes
+// every poller, to check its files again. That is simple and
+// cheap while pollers are few; when nobody polls, an event
+// costs one load.
+//
+
+#include "types.h"
+#include "param.h"
+#include "spinlock.h"
+#include "riscv.h"
+#include "defs.h"
+#include "proc.h"
+#include "fs.h"
+#include "sleeplock.h"
+#include "file.h"
+#include "fcntl.h"
+
+struct
+{
+  struct spinlock lock;
+  uint seq;   // counts events
+  int nwait;  // processes in poll()
+  int ntimed; // how many of them have a timeout
+} pollq;
+
+void pollinit(void)
+{
+  initlock(&pollq.lock, "poll");
+}
+
+// Something a poller may be waiting for has happened.
+// The caller holds the lock of the pipe or console that
+// changed. A poller counts itself in nwait before taking
+// that lock to check it, so if it missed the change, nwait
+// is seen to be non-zero here.
+void pollwakeup(void)
+{
+  if (pollq.nwait == 0)
+    return;
+  acquire(&pollq.lock);
+  pollq.seq++;
+  wakeup(&pollq);
+  release(&pollq.lock);
+}
+
+// Called on each clock tick, to let timeouts expire.
+void polltick(void)
+{
+  if (pollq.ntimed == 0)
+    return;
+  acquire(&pollq.lock);
+  pollq.seq++;
+  wakeup(&pollq);
+  release(&pollq.lock);
+}
+
+// Set revents for each of the n entries of pfd, and
+// return how many are non-zero.
+static int
+pollscan(struct pollfd *pfd, int n)
+{
+  struct proc *p = myproc();
+  struct file *f;
+  int i, ready = 0;
+
+  for (i = 0; i < n; i++)
+  {
+    pfd[i].revents = 0;
+    if (pfd[i].fd < 0)
+      continue; // ignored
+    if (pfd[i].fd >= NOFILE || (f = p->ofile[pfd[i].fd]) == 0)
+      pfd[i].revents = POLLNVAL;
+    else
+      pfd[i].revents = filepoll(f) & (pfd[i].events | POLLERR | POLLHUP);
+    if (pfd[i].revents)
+      ready++;
+  }
+  return ready;
+}
+
+// Wait until one of the n files in pfd is ready for what its
+// events ask, or timeout ticks pass (forever if timeout < 0).
+// Returns the number of ready files, 0 on timeout, or -1.
+int poll(struct pollfd *pfd, int n, int timeout)
+{
+  uint t0, seq;
+  int ready;
+
+  acquire(&tickslock);
+  t0 = ticks;
+  release(&tickslock);
+
+  acquire(&pollq.lock);
+  pollq.nwait++;
+  if (timeout > 0)
+    pollq.ntimed++;
+  for (;;)
+  {
+    seq = pollq.seq;
+    release(&pollq.lock);
+    ready = pollscan(pfd, n);
+    acquire(&pollq.lock);
+    if (ready || timeout == 0 || (timeout > 0 && ticks - t0 >= timeout))
+      break;
+    if (killed(myproc()))
+    {
+      ready = -1;
+      break;
+    }
+    // sleep, unless something happened while scanning.
+    if (pollq.seq == seq)
+      sleep(&pollq, &pollq.lock);
+  }
+  pollq.nwait--;
+  if (timeout > 0)
+    pollq.ntimed--;
+  release(&pollq.lock);
+  return ready;
+}
@@ -16,6 +16,7 @@ int nextpid = 1;
 struct spinlock pid_lock;
 
 extern void forkret(void);
+static void kthreadret(void);
 static void freeproc(struct proc *p);
 
 extern char trampoline[]; // trampoline.S
@@ -169,6 +170,7 @@ freeproc(struct proc *p)
   p->pid = 0;
   p->parent = 0;
   p->name[0] = 0;
+  p->kfn = 0;
   p->chan = 0;
   p->killed = 0;
   p->xstate = 0;
@@ -257,6 +259,25 @@ void userinit(void)
   release(&p->lock);
 }
 
+// Start a kernel thread that runs fn(), which must not return.
+// The thread has no user memory, no parent and no open files,
+// and runs only in the kernel.
+void kthread(void (*fn)(void), char *name)
+{
+  struct proc *p;
+
+  if ((p = allocproc()) == 0)
+    panic("kthread");
+
+  p->kfn = fn;
+  p->context.ra = (uint64)kthreadret;
+  safestrcpy(p->name, name, sizeof(p->name));
+
+  p->state = RUNNABLE;
+
+  release(&p->lock);
+}
+
 // Grow or shrink user memory by n bytes.
 // Return 0 on success, -1 on failure.
 int growproc(int n)
@@ -557,6 +578,20 @@ void forkret(void)
   usertrapret();
 }
 
+// A kernel thread's very first scheduling by scheduler()
+// will swtch to kthreadret.
+static void
+kthreadret(void)
+{
+  struct proc *p = myproc();
+
+  // Still holding p->lock from scheduler.
+  release(&p->lock);
+
+  p->kfn();
+  panic("kthread returned");
+}
+
 // Atomically release lock and sleep on chan.
 // Reacquires lock when awakened.
 void sleep(void *chan, struct spinlock *lk)
@@ -116,4 +116,5 @@ struct proc
   struct file *ofile[NOFILE];  // Open files
   struct inode *cwd;           // Current directory
   char name[16];               // Process name (debugging)
+  void (*kfn)(void);           // Body of a kernel thread, or 0
 };
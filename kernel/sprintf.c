@@ -0,0 +1,131 @@
+//
+// formatted output into a kernel buffer -- snprintf.
+//
+
+#include <stdarg.h>
+
+#include "types.h"
+#include "param.h"
+#include "spinlock.h"
+#include "sleeplock.h"
+#include "fs.h"
+#include "file.h"
+#include "riscv.h"
+#include "defs.h"
+
+static char digits[] = "0123456789abcdef";
+
+// append c to buf if there is room, always counting it.
+static void
+sputc(char *buf, int sz, int *off, char c)
+{
+  if (*off < sz)
+    buf[*off] = c;
+  (*off)++;
+}
+
+static void
+sprintint(char *buf, int sz, int *off, long long xx, int base, int sign)
+{
+  char tmp[24];
+  int i;
+  unsigned long long x;
+
+  if (sign && (sign = (xx < 0)))
+    x = -xx;
+  else
+    x = xx;
+
+  i = 0;
+  do
+  {
+    tmp[i++] = digits[x % base];
+  } while ((x /= base) != 0);
+
+  if (sign)
+    tmp[i++] = '-';
+
+  while (--i >= 0)
+    sputc(buf, sz, off, tmp[i]);
+}
+
+// Format into buf, which has room for sz bytes.
+// Understands the same conversions as printf(), less %p.
+// Output is truncated to fit; the result is not nul-terminated.
+// Returns the number of bytes stored in buf.
+int snprintf(char *buf, int sz, char *fmt, ...)
+{
+  va_list ap;
+  int i, cx, c0, c1, off;
+  char *s;
+
+  if (sz <= 0)
+    return 0;
+
+  off = 0;
+  va_start(ap, fmt);
+  for (i = 0; (cx = fmt[i] & 0xff) != 0; i++)
+  {
+    if (cx != '%')
+    {
+      sputc(buf, sz, &off, cx);
+      continue;
+    }
+    i++;
+    c0 = fmt[i + 0] & 0xff;
+    c1 = 0;
+    if (c0)
+      c1 = fmt[i + 1] & 0xff;
+    if (c0 == 'd')
+    {
+      sprintint(buf, sz, &off, va_arg(ap, int), 10, 1);
+    }
+    else if (c0 == 'l' && c1 == 'd')
+    {
+      sprintint(buf, sz, &off, va_arg(ap, uint64), 10, 1);
+      i += 1;
+    }
+    else if (c0 == 'u')
+    {
+      sprintint(buf, sz, &off, va_arg(ap, uint), 10, 0);
+    }
+    else if (c0 == 'l' && c1 == 'u')
+    {
+      sprintint(buf, sz, &off, va_arg(ap, uint64), 10, 0);
+      i += 1;
+    }
+    else if (c0 == 'x')
+    {
+      sprintint(buf, sz, &off, va_arg(ap, uint), 16, 0);
+    }
+    else if (c0 == 'l' && c1 == 'x')
+    {
+      sprintint(buf, sz, &off, va_arg(ap, uint64), 16, 0);
+      i += 1;
+    }
+    else if (c0 == 's')
+    {
+      if ((s = va_arg(ap, char *)) == 0)
+        s = "(null)";
+      for (; *s; s++)
+        sputc(buf, sz, &off, *s);
+    }
+    else if (c0 == '%')
+    {
+      sputc(buf, sz, &off, '%');
+    }
+    else if (c0 == 0)
+    {
+      break;
+    }
+    else
+    {
+      // Print unknown % sequence to draw attention.
+      sputc(buf, sz, &off, '%');
+      sputc(buf, sz, &off, c0);
+    }
+  }
+  va_end(ap);
+
+  return off < sz ? off : sz;
+}
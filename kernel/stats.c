@@ -0,0 +1,72 @@
+//
+// the statistics device: reading it returns a text
+// report of kernel counters, one subsystem after another.
+// each open()/read()-to-EOF sequence takes a fresh snapshot.
+//
+
+#include "types.h"
+#include "param.h"
+#include "spinlock.h"
+#include "sleeplock.h"
+#include "fs.h"
+#include "file.h"
+#include "riscv.h"
+#include "defs.h"
+
+#define BUFSZ 4096
+
+static struct
+{
+  struct spinlock lock;
+  char buf[BUFSZ];
+  int sz;
+  int off;
+} stats;
+
+int statswrite(int user_src, uint64 src, int n)
+{
+  return -1;
+}
+
+int statsread(int user_dst, uint64 dst, int n, int nonblock)
+{
+  int m;
+
+  acquire(&stats.lock);
+
+  if (stats.sz == 0)
+  {
+    stats.sz += virtio_disk_stats(stats.buf + stats.sz, BUFSZ - stats.sz);
+    stats.sz += log_stats(stats.buf + stats.sz, BUFSZ - stats.sz);
+    stats.sz += icache_stats(stats.buf + stats.sz, BUFSZ - stats.sz);
+    stats.sz += dcache_stats(stats.buf + stats.sz, BUFSZ - stats.sz);
+  }
+  m = stats.sz - stats.off;
+
+  if (m > 0)
+  {
+    if (m > n)
+      m = n;
+    if (either_copyout(user_dst, dst, stats.buf + stats.off, m) != -1)
+    {
+      stats.off += m;
+    }
+  }
+  else
+  {
+    // report end-of-file, and start over next time.
+    m = 0;
+    stats.sz = 0;
+    stats.off = 0;
+  }
+  release(&stats.lock);
+  return m;
+}
+
+void statsinit(void)
+{
+  initlock(&stats.lock, "stats");
+
+  devsw[STATS].read = statsread;
+  devsw[STATS].write = statswrite;
+}
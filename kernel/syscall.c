@@ -97,6 +97,22 @@ extern uint64 sys_unlink(void);
 extern uint64 sys_link(void);
 extern uint64 sys_mkdir(void);
 extern uint64 sys_close(void);
+extern uint64 sys_fsync(void);
+extern uint64 sys_fmap(void);
+extern uint64 sys_fcntl(void);
+extern uint64 sys_splice(void);
+extern uint64 sys_sendfile(void);
+extern uint64 sys_lseek(void);
+extern uint64 sys_pread(void);
+extern uint64 sys_pwrite(void);
+extern uint64 sys_readv(void);
+extern uint64 sys_writev(void);
+extern uint64 sys_getdents(void);
+extern uint64 sys_poll(void);
+extern uint64 sys_epoll_create(void);
+extern uint64 sys_epoll_ctl(void);
+extern uint64 sys_epoll_wait(void);
+extern uint64 sys_ioctl(void);
 
 // An array mapping syscall numbers from syscall.h
 // to the function that handles the system call.
@@ -122,6 +138,22 @@ static uint64 (*syscalls[])(void) = {
     [SYS_link] sys_link,
     [SYS_mkdir] sys_mkdir,
     [SYS_close] sys_close,
+    [SYS_fsync] sys_fsync,
+    [SYS_fmap] sys_fmap,
+    [SYS_fcntl] sys_fcntl,
+    [SYS_splice] sys_splice,
+    [SYS_sendfile] sys_sendfile,
+    [SYS_lseek] sys_lseek,
+    [SYS_pread] sys_pread,
+    [SYS_pwrite] sys_pwrite,
+    [SYS_readv] sys_readv,
+    [SYS_writev] sys_writev,
+    [SYS_getdents] sys_getdents,
+    [SYS_poll] sys_poll,
+    [SYS_epoll_create] sys_epoll_create,
+    [SYS_epoll_ctl] sys_epoll_ctl,
+    [SYS_epoll_wait] sys_epoll_wait,
+    [SYS_ioctl] sys_ioctl,
 };
 
 void syscall(void)
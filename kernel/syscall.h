@@ -20,3 +20,19 @@
 #define SYS_link 19
 #define SYS_mkdir 20
 #define SYS_close 21
+#define SYS_fsync 22
+#define SYS_fmap 23
+#define SYS_fcntl 24
+#define SYS_splice 25
+#define SYS_sendfile 26
+#define SYS_lseek 27
+#define SYS_pread 28
+#define SYS_pwrite 29
+#define SYS_readv 30
+#define SYS_writev 31
+#define SYS_getdents 32
+#define SYS_poll 33
+#define SYS_epoll_create 34
+#define SYS_epoll_ctl 35
+#define SYS_epoll_wait 36
+#define SYS_ioctl 37
@@ -78,7 +78,7 @@ sys_read(void)
   argint(2, &n);
   if (argfd(0, 0, &f) < 0)
     return -1;
-  return fileread(f, p, n);
+  return fileread(f, 1, p, n);
 }
 
 uint64
@@ -93,7 +93,252 @@ sys_write(void)
   if (argfd(0, 0, &f) < 0)
     return -1;
 
-  return filewrite(f, p, n);
+  return filewrite(f, 1, p, n);
+}
+
+// lseek(fd, off, whence): set fd's offset; returns the new offset.
+uint64
+sys_lseek(void)
+{
+  struct file *f;
+  int off, whence;
+
+  argint(1, &off);
+  argint(2, &whence);
+  if (argfd(0, 0, &f) < 0)
+    return -1;
+  return fileseek(f, off, whence);
+}
+
+// pread(fd, buf, n, off): read at off, leaving fd's offset alone.
+uint64
+sys_pread(void)
+{
+  struct file *f;
+  int n, off;
+  uint64 p;
+
+  argaddr(1, &p);
+  argint(2, &n);
+  argint(3, &off);
+  if (argfd(0, 0, &f) < 0 || off < 0)
+    return -1;
+  return filepread(f, 1, p, n, off);
+}
+
+// pwrite(fd, buf, n, off): write at off, leaving fd's offset alone.
+uint64
+sys_pwrite(void)
+{
+  struct file *f;
+  int n, off;
+  uint64 p;
+
+  argaddr(1, &p);
+  argint(2, &n);
+  argint(3, &off);
+  if (argfd(0, 0, &f) < 0 || off < 0)
+    return -1;
+  return filepwrite(f, 1, p, n, off);
+}
+
+// getdents(fd, buf, n, flags): read up to n entries of directory
+// fd into buf, an array of struct dirstat, continuing where the
+// last call left off. Returns the number read, 0 at the end.
+uint64
+sys_getdents(void)
+{
+  struct file *f;
+  int n, flags, r;
+  uint64 p;
+
+  argaddr(1, &p);
+  argint(2, &n);
+  argint(3, &flags);
+  if (argfd(0, 0, &f) < 0 || f->type != FD_INODE || f->readable == 0 || n < 0)
+    return -1;
+  ilock(f->ip);
+  r = dirread(f->ip, 1, p, n, &f->off, flags & GD_STAT);
+  iunlock(f->ip);
+  return r;
+}
+
+// poll(fds, n, timeout): wait until one of n files is ready,
+// or for timeout ticks (forever if negative).
+uint64
+sys_poll(void)
+{
+  struct pollfd pfd[NOFILE];
+  struct proc *p = myproc();
+  uint64 ufds;
+  int n, timeout, r;
+
+  argaddr(0, &ufds);
+  argint(1, &n);
+  argint(2, &timeout);
+  if (n < 0 || n > NOFILE)
+    return -1;
+  if (copyin(p->pagetable, (char *)pfd, ufds, n * sizeof(pfd[0])) < 0)
+    return -1;
+  if ((r = poll(pfd, n, timeout)) < 0)
+    return -1;
+  if (copyout(p->pagetable, ufds, (char *)pfd, n * sizeof(pfd[0])) < 0)
+    return -1;
+  return r;
+}
+
+// epoll_create(): a descriptor for a new, empty epoll instance.
+uint64
+sys_epoll_create(void)
+{
+  struct eventpoll *ep;
+  struct file *f;
+  int fd;
+
+  if ((ep = epollalloc()) == 0)
+    return -1;
+  if ((f = filealloc()) == 0)
+  {
+    epollclose(ep);
+    return -1;
+  }
+  f->type = FD_EPOLL;
+  f->readable = 0;
+  f->writable = 0;
+  f->ep = ep;
+  if ((fd = fdalloc(f)) < 0)
+  {
+    fileclose(f);
+    return -1;
+  }
+  return fd;
+}
+
+// epoll_ctl(epfd, op, fd, event): add fd to epfd's instance,
+// change what it watches for, or remove it.
+uint64
+sys_epoll_ctl(void)
+{
+  struct file *epf, *f;
+  struct epoll_event ev;
+  uint64 uev;
+  int op;
+
+  argint(1, &op);
+  argaddr(3, &uev);
+  if (argfd(0, 0, &epf) < 0 || epf->type != FD_EPOLL || argfd(2, 0, &f) < 0)
+    return -1;
+  if (op != EPOLL_CTL_DEL &&
+      copyin(myproc()->pagetable, (char *)&ev, uev, sizeof(ev)) < 0)
+    return -1;
+  return epollctl(epf->ep, op, f, &ev);
+}
+
+// epoll_wait(epfd, events, max, timeout): wait for files of
+// epfd's instance to be ready, for up to timeout ticks, and
+// return up to max of them in events.
+uint64
+sys_epoll_wait(void)
+{
+  struct epoll_event ev[NEPEVENT];
+  struct file *f;
+  uint64 uev;
+  int max, timeout, n;
+
+  argaddr(1, &uev);
+  argint(2, &max);
+  argint(3, &timeout);
+  if (argfd(0, 0, &f) < 0 || f->type != FD_EPOLL || max <= 0)
+    return -1;
+  if (max > NEPEVENT)
+    max = NEPEVENT;
+  if ((n = epollwait(f->ep, ev, max, timeout)) <= 0)
+    return n;
+  if (copyout(myproc()->pagetable, uev, (char *)ev, n * sizeof(ev[0])) < 0)
+    return -1;
+  return n;
+}
+
+// splice(fdin, fdout, n): move up to n bytes from fdin to fdout
+// without copying them through user memory.
+uint64
+sys_splice(void)
+{
+  struct file *in, *out;
+  int n;
+
+  argint(2, &n);
+  if (argfd(0, 0, &in) < 0 || argfd(1, 0, &out) < 0)
+    return -1;
+  return filesplice(in, out, n);
+}
+
+// sendfile(fdout, fdin, off, n): move up to n bytes of the file
+// fdin, starting at off, to fdout. fdin's offset is unchanged.
+uint64
+sys_sendfile(void)
+{
+  struct file *in, *out;
+  int off, n;
+
+  argint(2, &off);
+  argint(3, &n);
+  if (argfd(0, 0, &out) < 0 || argfd(1, 0, &in) < 0)
+    return -1;
+  return filesendfile(out, in, off, n);
+}
+
+// Fetch the iovec array of cnt entries at user address uiov
+// for readv() or writev().
+static int
+argiov(uint64 uiov, int cnt, struct iovec *iov)
+{
+  uint64 n = 0;
+  int i;
+
+  if (cnt < 0 || cnt > IOV_MAX)
+    return -1;
+  if (copyin(myproc()->pagetable, (char *)iov, uiov, cnt * sizeof(struct iovec)) < 0)
+    return -1;
+  for (i = 0; i < cnt; i++)
+  {
+    n += iov[i].iov_len;
+    if (iov[i].iov_len > 0x7fffffff || n > 0x7fffffff)
+      return -1;
+  }
+  return 0;
+}
+
+// readv(fd, iov, cnt): read into cnt buffers with one call.
+uint64
+sys_readv(void)
+{
+  struct file *f;
+  struct iovec iov[IOV_MAX];
+  uint64 uiov;
+  int cnt;
+
+  argaddr(1, &uiov);
+  argint(2, &cnt);
+  if (argfd(0, 0, &f) < 0 || argiov(uiov, cnt, iov) < 0)
+    return -1;
+  return filereadv(f, 1, iov, cnt);
+}
+
+// writev(fd, iov, cnt): write cnt buffers with one call.
+uint64
+sys_writev(void)
+{
+  struct file *f;
+  struct iovec iov[IOV_MAX];
+  uint64 uiov;
+  int cnt;
+
+  argaddr(1, &uiov);
+  argint(2, &cnt);
+  if (argfd(0, 0, &f) < 0 || argiov(uiov, cnt, iov) < 0)
+    return -1;
+  return filewritev(f, 1, iov, cnt);
 }
 
 uint64
@@ -109,6 +354,83 @@ sys_close(void)
   return 0;
 }
 
+// Wait until the file's updates, and every other
+// completed file system update, are on disk.
+uint64
+sys_fsync(void)
+{
+  struct file *f;
+
+  if (argfd(0, 0, &f) < 0)
+    return -1;
+  log_sync();
+  return 0;
+}
+
+// return the disk block holding block bn of an open file,
+// 0 if there is none (a hole, or past the end).
+uint64
+sys_fmap(void)
+{
+  struct file *f;
+  int bn;
+  uint addr;
+
+  argint(1, &bn);
+  if (argfd(0, 0, &f) < 0 || f->type != FD_INODE || bn < 0)
+    return -1;
+  ilock(f->ip);
+  addr = ibmap(f->ip, bn);
+  iunlock(f->ip);
+  return addr;
+}
+
+// ioctl(fd, req, arg): a request for fd's device, such as
+// setting the console's input mode.
+uint64
+sys_ioctl(void)
+{
+  struct file *f;
+  int req, arg;
+
+  argint(1, &req);
+  argint(2, &arg);
+  if (argfd(0, 0, &f) < 0)
+    return -1;
+  return fileioctl(f, req, arg);
+}
+
+// fcntl(fd, cmd, arg): query or change an open file's settings.
+uint64
+sys_fcntl(void)
+{
+  struct file *f;
+  int cmd, arg;
+
+  argint(1, &cmd);
+  argint(2, &arg);
+  if (argfd(0, 0, &f) < 0)
+    return -1;
+  switch (cmd)
+  {
+  case F_GETPIPE_SZ:
+    if (f->type != FD_PIPE)
+      return -1;
+    return pipegetsize(f->pipe);
+  case F_SETPIPE_SZ:
+    if (f->type != FD_PIPE)
+      return -1;
+    return pipesetsize(f->pipe, arg);
+  case F_GETFL:
+    return (f->readable && f->writable ? O_RDWR : f->writable ? O_WRONLY : O_RDONLY) |
+           (f->nonblock ? O_NONBLOCK : 0);
+  case F_SETFL:
+    f->nonblock = (arg & O_NONBLOCK) != 0;
+    return 0;
+  }
+  return -1;
+}
+
 uint64
 sys_fstat(void)
 {
@@ -230,6 +552,7 @@ sys_unlink(void)
   memset(&de, 0, sizeof(de));
   if (writei(dp, 0, (uint64)&de, off, sizeof(de)) != sizeof(de))
     panic("unlink: writei");
+  dcache_enter(dp->dev, dp->inum, name, 0);
   if (ip->type == T_DIR)
   {
     dp->nlink--;
@@ -272,7 +595,7 @@ create(char *path, short type, short major, short minor)
     return 0;
   }
 
-  if ((ip = ialloc(dp->dev, type)) == 0)
+  if ((ip = ialloc(dp->dev, type, dp->inum)) == 0)
   {
     iunlockput(dp);
     return 0;
@@ -346,7 +669,7 @@ sys_open(void)
       return -1;
     }
     ilock(ip);
-    if (ip->type == T_DIR && omode != O_RDONLY)
+    if (ip->type == T_DIR && (omode & (O_WRONLY | O_RDWR | O_TRUNC)))
     {
       iunlockput(ip);
       end_op();
@@ -383,10 +706,16 @@ sys_open(void)
   f->ip = ip;
   f->readable = !(omode & O_WRONLY);
   f->writable = (omode & O_WRONLY) || (omode & O_RDWR);
+  f->nonblock = (omode & O_NONBLOCK) != 0;
 
   if ((omode & O_TRUNC) && ip->type == T_FILE)
   {
-    itrunc(ip);
+    itruncop(ip);
+  }
+
+  if ((omode & O_BLOCKMAP) && ip->type == T_FILE && ip->size == 0)
+  {
+    iblockmap(ip);
   }
 
   iunlock(ip);
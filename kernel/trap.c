@@ -169,6 +169,8 @@ void clockintr()
     ticks++;
     wakeup(&ticks);
     release(&tickslock);
+    polltick();
+    epolltick();
   }
 
   // ask for the next timer interrupt. this also clears
@@ -186,6 +186,7 @@ void uartintr(void)
       break;
     consoleintr(c);
   }
+  consolewake();
 
   // send buffered characters.
   acquire(&uart_tx_lock);
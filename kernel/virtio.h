@@ -45,9 +45,17 @@
 #define VIRTIO_RING_F_INDIRECT_DESC 28
 #define VIRTIO_RING_F_EVENT_IDX 29
 
-// this many virtio descriptors.
-// must be a power of two.
-#define NUM 8
+// this many virtio descriptors, at most.
+// must be a power of two, and the descriptor table
+// (16 bytes each) must fit in one page, so at most 256.
+// virtio_disk_init() uses fewer if the device's
+// QUEUE_NUM_MAX is smaller.
+#ifndef NUM
+#define NUM 64
+#endif
+#if (NUM & (NUM - 1)) != 0 || NUM > 256
+#error "NUM must be a power of two, at most 256"
+#endif
 
 // a single descriptor, from the spec.
 struct virtq_desc
@@ -61,13 +69,17 @@ struct virtq_desc
 #define VRING_DESC_F_WRITE 2 // device writes (vs read)
 
 // the (entire) avail ring, from the spec.
+// with VIRTIO_RING_F_EVENT_IDX the 16-bit word after the
+// last ring[] entry in use is used_event: the device only
+// interrupts once used->idx moves past it.
 struct virtq_avail
 {
-  uint16 flags;     // always zero
+  uint16 flags;     // VRING_AVAIL_F_NO_INTERRUPT, or zero
   uint16 idx;       // driver will write ring[idx] next
   uint16 ring[NUM]; // descriptor numbers of chain heads
   uint16 unused;
 };
+#define VRING_AVAIL_F_NO_INTERRUPT 1 // ignored with EVENT_IDX
 
 // one entry in the "used" ring, with which the
 // device tells the driver about completed requests.
@@ -77,12 +89,23 @@ struct virtq_used_elem
   uint32 len;
 };
 
+// with VIRTIO_RING_F_EVENT_IDX the 16-bit word after the
+// last ring[] entry in use is avail_event: the device only
+// wants a QUEUE_NOTIFY once avail->idx moves past it.
 struct virtq_used
 {
-  uint16 flags; // always zero
+  uint16 flags; // VRING_USED_F_NO_NOTIFY, or zero
   uint16 idx;   // device increments when it adds a ring[] entry
   struct virtq_used_elem ring[NUM];
+  uint16 unused;
 };
+#define VRING_USED_F_NO_NOTIFY 1 // ignored with EVENT_IDX
+
+// with EVENT_IDX, should an index update from old to new_idx
+// trigger a notification if the other side asked for one at
+// event? this is vring_need_event() from the spec, 2.6.7.2.
+#define VRING_NEED_EVENT(event, new_idx, old) \
+  ((uint16)((new_idx) - (event) - 1) < (uint16)((new_idx) - (old)))
 
 // these are specific to virtio block devices, e.g. disks,
 // described in Section 5.2 of the spec.
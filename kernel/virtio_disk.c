@@ -23,7 +23,7 @@ static struct disk
 {
   // a set (not a ring) of DMA descriptors, with which the
   // driver tells the device where to read and write individual
-  // disk operations. there are NUM descriptors.
+  // disk operations. there are disk.num descriptors.
   // most commands consist of a "chain" (a linked list) of a couple of
   // these descriptors.
   struct virtq_desc *desc;
@@ -31,17 +31,17 @@ static struct disk
   // a ring in which the driver writes descriptor numbers
   // that the driver would like the device to process.  it only
   // includes the head descriptor of each chain. the ring has
-  // NUM elements.
+  // disk.num elements.
   struct virtq_avail *avail;
 
   // a ring in which the device writes descriptor numbers that
   // the device has finished processing (just the head of each chain).
-  // there are NUM used ring entries.
+  // there are disk.num used ring entries.
   struct virtq_used *used;
 
   // our own book-keeping.
   char free[NUM];  // is a descriptor free?
-  uint16 used_idx; // we've looked this far in used[2..NUM].
+  uint16 used_idx; // we've looked this far in used[2..disk.num].
 
   // track info about in-flight operations,
   // for use when completion interrupt arrives.
@@ -56,10 +56,36 @@ static struct disk
   // one-for-one with descriptors, for convenience.
   struct virtio_blk_req ops[NUM];
 
+  int num;       // queue size in use; power of two, <= NUM.
+  int event_idx; // negotiated VIRTIO_RING_F_EVENT_IDX?
+  int poll;      // spin for completions instead of sleeping.
+  int inflight;  // requests in the avail ring, not yet completed.
+  uint16 kicked; // avail->idx as of the last kick.
+
+  // counters, reported via the statistics device.
+  struct
+  {
+    uint64 req;      // requests submitted
+    uint64 batch;    // calls to virtio_disk_rwv()
+    uint64 intr;     // completion interrupts taken
+    uint64 complete; // used ring entries processed
+    uint64 notify;   // QUEUE_NOTIFY register writes
+    uint64 nonotify; // notifies the device said it didn't need
+    uint64 polled;   // polling passes that found completions
+  } st;
+
   struct spinlock vdisk_lock;
 
 } disk;
 
+// the used_event word, just past the avail ring in use.
+#define USED_EVENT (*(volatile uint16 *)&disk.avail->ring[disk.num])
+// the avail_event word, just past the used ring in use.
+#define AVAIL_EVENT (*(volatile uint16 *)&disk.used->ring[disk.num])
+
+static void virtio_disk_complete(void);
+static void virtio_disk_kick(void);
+
 void virtio_disk_init(void)
 {
   uint32 status = 0;
@@ -92,9 +118,11 @@ void virtio_disk_init(void)
   features &= ~(1 << VIRTIO_BLK_F_CONFIG_WCE);
   features &= ~(1 << VIRTIO_BLK_F_MQ);
   features &= ~(1 << VIRTIO_F_ANY_LAYOUT);
-  features &= ~(1 << VIRTIO_RING_F_EVENT_IDX);
   features &= ~(1 << VIRTIO_RING_F_INDIRECT_DESC);
+  // keep VIRTIO_RING_F_EVENT_IDX if the device offers it.
   *R(VIRTIO_MMIO_DRIVER_FEATURES) = features;
+  disk.event_idx = (features & (1 << VIRTIO_RING_F_EVENT_IDX)) != 0;
+  disk.poll = DISKPOLL;
 
   // tell device that feature negotiation is complete.
   status |= VIRTIO_CONFIG_S_FEATURES_OK;
@@ -116,7 +144,10 @@ void virtio_disk_init(void)
   uint32 max = *R(VIRTIO_MMIO_QUEUE_NUM_MAX);
   if (max == 0)
     panic("virtio disk has no queue 0");
-  if (max < NUM)
+  disk.num = NUM;
+  while (disk.num > max)
+    disk.num /= 2;
+  if (disk.num < 3)
     panic("virtio disk max queue too short");
 
   // allocate and zero queue memory.
@@ -130,7 +161,16 @@ void virtio_disk_init(void)
   memset(disk.used, 0, PGSIZE);
 
   // set queue size.
-  *R(VIRTIO_MMIO_QUEUE_NUM) = NUM;
+  *R(VIRTIO_MMIO_QUEUE_NUM) = disk.num;
+
+  // in polled mode, ask the device not to interrupt at all.
+  // with EVENT_IDX that's done through used_event instead,
+  // which stays one behind disk.used_idx.
+  if (disk.poll)
+  {
+    disk.avail->flags = VRING_AVAIL_F_NO_INTERRUPT;
+    USED_EVENT = disk.used_idx - 1;
+  }
 
   // write physical addresses.
   *R(VIRTIO_MMIO_QUEUE_DESC_LOW) = (uint64)disk.desc;
@@ -143,8 +183,8 @@ void virtio_disk_init(void)
   // queue is ready.
   *R(VIRTIO_MMIO_QUEUE_READY) = 0x1;
 
-  // all NUM descriptors start out unused.
-  for (int i = 0; i < NUM; i++)
+  // all disk.num descriptors start out unused.
+  for (int i = 0; i < disk.num; i++)
     disk.free[i] = 1;
 
   // tell device we're completely ready.
@@ -158,7 +198,7 @@ void virtio_disk_init(void)
 static int
 alloc_desc()
 {
-  for (int i = 0; i < NUM; i++)
+  for (int i = 0; i < disk.num; i++)
   {
     if (disk.free[i])
     {
@@ -173,7 +213,7 @@ alloc_desc()
 static void
 free_desc(int i)
 {
-  if (i >= NUM)
+  if (i >= disk.num)
     panic("free_desc 1");
   if (disk.free[i])
     panic("free_desc 2");
@@ -219,12 +259,13 @@ alloc3_desc(int *idx)
   return 0;
 }
 
-void virtio_disk_rw(struct buf *b, int write)
+// queue one request for b in the avail ring, without telling
+// the device. caller holds vdisk_lock.
+static void
+virtio_disk_queue(struct buf *b, int write)
 {
   uint64 sector = b->blockno * (BSIZE / 512);
 
-  acquire(&disk.vdisk_lock);
-
   // the spec's Section 5.2 says that legacy block operations use
   // three descriptors: one for type/reserved/sector, one for the
   // data, one for a 1-byte status result.
@@ -237,7 +278,12 @@ void virtio_disk_rw(struct buf *b, int write)
     {
       break;
     }
-    sleep(&disk.free[0], &disk.vdisk_lock);
+    // the requests holding descriptors may not have been
+    // announced yet. completions free descriptors.
+    virtio_disk_kick();
+    virtio_disk_complete();
+    if (!disk.poll)
+      sleep(&disk.free[0], &disk.vdisk_lock);
   }
 
   // format the three descriptors.
@@ -277,29 +323,145 @@ void virtio_disk_rw(struct buf *b, int write)
   disk.info[idx[0]].b = b;
 
   // tell the device the first index in our chain of descriptors.
-  disk.avail->ring[disk.avail->idx % NUM] = idx[0];
+  uint16 old = disk.avail->idx;
+  disk.avail->ring[old % disk.num] = idx[0];
 
   __sync_synchronize();
 
-  // tell the device another avail ring entry is available.
-  disk.avail->idx += 1; // not % NUM ...
+  // another avail ring entry is available.
+  disk.avail->idx = old + 1; // not % disk.num ...
+  disk.inflight += 1;
+  disk.st.req += 1;
+}
 
-  __sync_synchronize();
+// tell the device about avail ring entries queued since
+// the last kick. caller holds vdisk_lock.
+static void
+virtio_disk_kick(void)
+{
+  uint16 old = disk.kicked;
+  uint16 new = disk.avail->idx;
 
-  *R(VIRTIO_MMIO_QUEUE_NOTIFY) = 0; // value is queue number
+  if (old == new)
+    return;
+  disk.kicked = new;
 
-  // Wait for virtio_disk_intr() to say request has finished.
-  while (b->disk == 1)
+  __sync_synchronize();
+
+  // with EVENT_IDX the device says, through avail_event, whether
+  // it is still working through the avail ring and will see these
+  // entries without being told.
+  if (!disk.event_idx || VRING_NEED_EVENT(AVAIL_EVENT, new, old))
+  {
+    *R(VIRTIO_MMIO_QUEUE_NOTIFY) = 0; // value is queue number
+    disk.st.notify += 1;
+  }
+  else
   {
-    sleep(b, &disk.vdisk_lock);
+    disk.st.nonotify += 1;
   }
+}
+
+// read or write n blocks as one batch: queue them all, tell
+// the device once, and wait for all of them. the device may
+// complete them in any order.
+void virtio_disk_rwv(struct buf **bs, int n, int write)
+{
+  acquire(&disk.vdisk_lock);
 
-  disk.info[idx[0]].b = 0;
-  free_chain(idx[0]);
+  for (int i = 0; i < n; i++)
+    virtio_disk_queue(bs[i], write);
+  virtio_disk_kick();
+  disk.st.batch += 1;
+
+  for (int i = 0; i < n; i++)
+  {
+    struct buf *b = bs[i];
+    if (disk.poll)
+    {
+      // spin until the device has finished this request;
+      // other CPUs' requests wait for vdisk_lock meanwhile.
+      while (b->disk == 1)
+      {
+        if (disk.used_idx != disk.used->idx)
+          disk.st.polled += 1;
+        virtio_disk_complete();
+      }
+    }
+    else
+    {
+      // move used_event to cover the new requests, and pick up
+      // anything that completed before it was moved.
+      virtio_disk_complete();
+
+      // Wait for virtio_disk_intr() to say request has finished.
+      while (b->disk == 1)
+      {
+        sleep(b, &disk.vdisk_lock);
+      }
+    }
+  }
 
   release(&disk.vdisk_lock);
 }
 
+void virtio_disk_rw(struct buf *b, int write)
+{
+  virtio_disk_rwv(&b, 1, write);
+}
+
+// process the used ring entries the device has added since
+// we last looked, then tell the device (via used_event) when
+// to interrupt next. caller holds vdisk_lock.
+//
+// with EVENT_IDX, one interrupt covers every request that is
+// in flight: used_event is the used ring index of the last of
+// them. a synchronous caller may so wait a little longer for
+// its own completion, but a burst of N requests costs one
+// interrupt rather than N. polled mode keeps used_event behind
+// disk.used_idx so that the device never interrupts.
+static void
+virtio_disk_complete(void)
+{
+  while (1)
+  {
+    // the device increments disk.used->idx when it
+    // adds an entry to the used ring.
+    while (disk.used_idx != disk.used->idx)
+    {
+      __sync_synchronize();
+      int id = disk.used->ring[disk.used_idx % disk.num].id;
+
+      if (disk.info[id].status != 0)
+        panic("virtio_disk_intr status");
+
+      struct buf *b = disk.info[id].b;
+      b->disk = 0; // disk is done with buf
+      wakeup(b);
+      disk.info[id].b = 0;
+      free_chain(id);
+
+      disk.used_idx += 1;
+      disk.inflight -= 1;
+      disk.st.complete += 1;
+    }
+
+    if (!disk.event_idx)
+      break;
+
+    if (disk.poll || disk.inflight == 0)
+      USED_EVENT = disk.used_idx - (disk.poll ? 1 : 0);
+    else
+      USED_EVENT = disk.used_idx + disk.inflight - 1;
+
+    // the device may have passed the new used_event before
+    // it was written, in which case it won't interrupt for it.
+    __sync_synchronize();
+    if (disk.used_idx == disk.used->idx)
+      break;
+  }
+}
+
 void virtio_disk_intr()
 {
   acquire(&disk.vdisk_lock);
@@ -311,26 +473,35 @@ void virtio_disk_intr()
   // completion entries in this interrupt, and have nothing to do
   // in the next interrupt, which is harmless.
   *R(VIRTIO_MMIO_INTERRUPT_ACK) = *R(VIRTIO_MMIO_INTERRUPT_STATUS) & 0x3;
+  disk.st.intr += 1;
 
   __sync_synchronize();
 
-  // the device increments disk.used->idx when it
-  // adds an entry to the used ring.
-
-  while (disk.used_idx != disk.used->idx)
-  {
-    __sync_synchronize();
-    int id = disk.used->ring[disk.used_idx % NUM].id;
+  virtio_disk_complete();
 
-    if (disk.info[id].status != 0)
-      panic("virtio_disk_intr status");
-
-    struct buf *b = disk.info[id].b;
-    b->disk = 0; // disk is done with buf
-    wakeup(b);
+  release(&disk.vdisk_lock);
+}
 
-    disk.used_idx += 1;
-  }
+// format the disk counters into buf, for the statistics device.
+// returns the number of bytes written.
+int virtio_disk_stats(char *buf, int sz)
+{
+  int n = 0;
+  uint64 req, intr;
 
+  acquire(&disk.vdisk_lock);
+  req = disk.st.req;
+  intr = disk.st.intr;
+  n += snprintf(buf + n, sz - n,
+                "virtio_disk: queue %d event_idx %d mode %s\n",
+                disk.num, disk.event_idx, disk.poll ? "poll" : "intr");
+  n += snprintf(buf + n, sz - n,
+                "virtio_disk: req %lu batches %lu intr %lu complete %lu polled %lu\n",
+                req, disk.st.batch, intr, disk.st.complete, disk.st.polled);
+  n += snprintf(buf + n, sz - n,
+                "virtio_disk: notify %lu suppressed %lu intr/100req %lu\n",
+                disk.st.notify, disk.st.nonotify,
+                req ? intr * 100 / req : 0);
   release(&disk.vdisk_lock);
+  return n;
 }
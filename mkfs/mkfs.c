@@ -27,8 +27,9 @@
 // [ boot block | sb block | log | inode blocks | free bit map | data blocks ]
 
 int nbitmap = FSSIZE / BPB + 1;
-int ninodeblocks = NINODES / IPB + 1;
-int nlog = LOGSIZE;
+int ninodes = NINODES; // -i, for file systems with many small files
+int ninodeblocks;
+int nlog;    // Number of log blocks; -l or a default scaled to FSSIZE
 int nmeta;   // Number of meta blocks (boot, sb, nlog, inode, bitmap)
 int nblocks; // Number of data blocks
 
@@ -78,9 +79,50 @@ int main(int argc, char *argv[])
 
   static_assert(sizeof(int) == 4, "Integers must be 4 bytes!");
 
+  // the log needs an anchor block plus a header and up to
+  // LOGSIZE blocks per transaction, and holds several
+  // transactions between checkpoints; by default spend 1/16
+  // of the disk, up to room for four full transactions.
+  nlog = FSSIZE / 16;
+  if (nlog > 1 + 4 * (LOGSIZE + 1))
+    nlog = 1 + 4 * (LOGSIZE + 1);
+  if (nlog < MAXOPBLOCKS + 2)
+    nlog = MAXOPBLOCKS + 2;
+
+  while (argc >= 3 && argv[1][0] == '-')
+  {
+    if (strcmp(argv[1], "-l") == 0)
+    {
+      nlog = atoi(argv[2]);
+      if (nlog < MAXOPBLOCKS + 2 || nlog > FSSIZE / 2)
+      {
+        fprintf(stderr, "mkfs: log size must be between %d and %d blocks\n",
+                MAXOPBLOCKS + 2, FSSIZE / 2);
+        exit(1);
+      }
+    }
+    else if (strcmp(argv[1], "-i") == 0)
+    {
+      ninodes = atoi(argv[2]);
+      if (ninodes < NINODES || ninodes > FSSIZE)
+      {
+        fprintf(stderr, "mkfs: inodes must be between %d and %d\n",
+                NINODES, FSSIZE);
+        exit(1);
+      }
+    }
+    else
+    {
+      break;
+    }
+    argc -= 2;
+    argv += 2;
+  }
+  ninodeblocks = ninodes / IPB + 1;
+
   if (argc < 2)
   {
-    fprintf(stderr, "Usage: mkfs fs.img files...\n");
+    fprintf(stderr, "Usage: mkfs [-l nlog] [-i ninodes] fs.img files...\n");
     exit(1);
   }
 
@@ -98,7 +140,7 @@ int main(int argc, char *argv[])
   sb.magic = FSMAGIC;
   sb.size = xint(FSSIZE);
   sb.nblocks = xint(nblocks);
-  sb.ninodes = xint(NINODES);
+  sb.ninodes = xint(ninodes);
   sb.nlog = xint(nlog);
   sb.logstart = xint(2);
   sb.inodestart = xint(2 + nlog);
@@ -224,7 +266,9 @@ uint ialloc(ushort type)
   struct dinode din;
 
   bzero(&din, sizeof(din));
-  din.type = xshort(type);
+  din.type = type;
+  if (type == T_FILE)
+    din.flags = IF_INLINE; // block-mapped once it outgrows inline
   din.nlink = xshort(1);
   din.size = xint(0);
   winode(inum, &din);
@@ -249,44 +293,92 @@ void balloc(int used)
 
 #define min(a, b) ((a) < (b) ? (a) : (b))
 
+// Return the disk block holding file block fbn of din,
+// allocating it, and any indirect blocks on the way, if needed.
+uint mapblock(struct dinode *din, uint fbn)
+{
+  uint indirect[NINDIRECT];
+  uint *slot, x, i, span;
+  int levels;
+
+  if (fbn < NDIRECT)
+  {
+    slot = &din->addrs[fbn];
+    levels = 0;
+  }
+  else if ((fbn -= NDIRECT) < NINDIRECT)
+  {
+    slot = &din->addrs[NDIRECT];
+    levels = 1;
+  }
+  else if ((fbn -= NINDIRECT) < NDINDIRECT)
+  {
+    slot = &din->addrs[NDIRECT + 1];
+    levels = 2;
+  }
+  else
+  {
+    fbn -= NDINDIRECT;
+    assert(fbn < NTINDIRECT);
+    slot = &din->addrs[NDIRECT + 2];
+    levels = 3;
+  }
+
+  if (xint(*slot) == 0)
+  {
+    *slot = xint(freeblock++);
+  }
+  x = xint(*slot);
+  for (span = 1, i = 1; i < levels; i++)
+    span *= NINDIRECT;
+  for (; levels > 0; levels--, span /= NINDIRECT)
+  {
+    rsect(x, (char *)indirect);
+    i = fbn / span;
+    fbn %= span;
+    if (indirect[i] == 0)
+    {
+      indirect[i] = xint(freeblock++);
+      wsect(x, (char *)indirect);
+    }
+    x = xint(indirect[i]);
+  }
+  return x;
+}
+
 void iappend(uint inum, void *xp, int n)
 {
   char *p = (char *)xp;
   uint fbn, off, n1;
   struct dinode din;
   char buf[BSIZE];
-  uint indirect[NINDIRECT];
   uint x;
 
   rinode(inum, &din);
   off = xint(din.size);
   // printf("append inum %d at off %d sz %d\n", inum, off, n);
+  if (din.flags & IF_INLINE)
+  {
+    if (off + n <= NINLINE)
+    {
+      bcopy(p, (char *)din.addrs + off, n);
+      din.size = xint(off + n);
+      winode(inum, &din);
+      return;
+    }
+    // too big to stay inline: move the data to block 0.
+    bzero(buf, BSIZE);
+    bcopy(din.addrs, buf, off);
+    bzero(din.addrs, sizeof(din.addrs));
+    din.flags &= ~IF_INLINE;
+    if (off > 0)
+      wsect(mapblock(&din, 0), buf);
+  }
   while (n > 0)
   {
     fbn = off / BSIZE;
     assert(fbn < MAXFILE);
-    if (fbn < NDIRECT)
-    {
-      if (xint(din.addrs[fbn]) == 0)
-      {
-        din.addrs[fbn] = xint(freeblock++);
-      }
-      x = xint(din.addrs[fbn]);
-    }
-    else
-    {
-      if (xint(din.addrs[NDIRECT]) == 0)
-      {
-        din.addrs[NDIRECT] = xint(freeblock++);
-      }
-      rsect(xint(din.addrs[NDIRECT]), (char *)indirect);
-      if (indirect[fbn - NDIRECT] == 0)
-      {
-        indirect[fbn - NDIRECT] = xint(freeblock++);
-        wsect(xint(din.addrs[NDIRECT]), (char *)indirect);
-      }
-      x = xint(indirect[fbn - NDIRECT]);
-    }
+    x = mapblock(&din, fbn);
     n1 = min(n, (fbn + 1) * BSIZE - off);
     rsect(x, buf);
     bcopy(p, buf + off - (fbn * BSIZE), n1);
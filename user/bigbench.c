@@ -0,0 +1,86 @@
+// bigbench: big-file throughput, for extent-mapped files and for
+// block-mapped ones (whose blocks past NDIRECT + NINDIRECT are
+// reached through doubly- and triply-indirect blocks).
+//
+//   bigbench [kb]    write, fsync and read back a kb-KB file
+//                    of each kind; the default is 1024 KB.
+//
+// times are in clock ticks, from uptime().
+
+#include "kernel/types.h"
+#include "kernel/stat.h"
+#include "user/user.h"
+#include "kernel/fs.h"
+#include "kernel/fcntl.h"
+
+#define CHUNK (8 * BSIZE) // bytes per write() or read()
+
+char buf[CHUNK];
+
+void bench(char *kind, int omode, int kb)
+{
+  int fd, i, n, t0, t1, t2, t3;
+  int total = kb * 1024;
+
+  unlink("bigbench.tmp");
+  fd = open("bigbench.tmp", O_CREATE | O_RDWR | omode);
+  if (fd < 0)
+  {
+    fprintf(2, "bigbench: cannot create bigbench.tmp\n");
+    exit(1);
+  }
+
+  t0 = uptime();
+  for (i = 0; i < total; i += n)
+  {
+    ((int *)buf)[0] = i;
+    n = total - i < CHUNK ? total - i : CHUNK;
+    if (write(fd, buf, n) != n)
+    {
+      fprintf(2, "bigbench: write failed at %d\n", i);
+      exit(1);
+    }
+  }
+  t1 = uptime();
+  fsync(fd);
+  t2 = uptime();
+  close(fd);
+
+  fd = open("bigbench.tmp", O_RDONLY);
+  for (i = 0; (n = read(fd, buf, CHUNK)) > 0; i += n)
+  {
+    if (((int *)buf)[0] != i)
+    {
+      fprintf(2, "bigbench: bad data at %d\n", i);
+      exit(1);
+    }
+  }
+  t3 = uptime();
+  close(fd);
+  unlink("bigbench.tmp");
+  if (i != total)
+  {
+    fprintf(2, "bigbench: read %d bytes of %d\n", i, total);
+    exit(1);
+  }
+
+  printf("%s: %d KB: write %d ticks, fsync %d ticks, read %d ticks\n",
+         kind, kb, t1 - t0, t2 - t1, t3 - t2);
+}
+
+int main(int argc, char *argv[])
+{
+  int kb = 1024;
+
+  if (argc > 1)
+    kb = atoi(argv[1]);
+  if (kb <= 0)
+  {
+    fprintf(2, "usage: bigbench [kb]\n");
+    exit(1);
+  }
+
+  bench("extent", 0, kb);
+  bench("blockmap", O_BLOCKMAP, kb);
+  exit(0);
+}
@@ -0,0 +1,96 @@
+// dirbench: create, look up and remove many files in one
+// directory, which is indexed once it outgrows its first block.
+//
+//   dirbench [n]     use n files; the default is 10000, which
+//                    needs more inodes than mkfs gives a small disk.
+//
+// times are in clock ticks, from uptime().
+
+#include "kernel/types.h"
+#include "kernel/stat.h"
+#include "user/user.h"
+#include "kernel/fcntl.h"
+
+// "f" followed by the decimal digits of i.
+void fname(char *buf, int i)
+{
+  char tmp[12];
+  int n = 0;
+
+  do
+  {
+    tmp[n++] = '0' + i % 10;
+    i /= 10;
+  } while (i > 0);
+  *buf++ = 'f';
+  while (n > 0)
+    *buf++ = tmp[--n];
+  *buf = 0;
+}
+
+int main(int argc, char *argv[])
+{
+  char name[16];
+  int n = 10000;
+  int i, fd, t0, t1, t2, t3;
+
+  if (argc > 1)
+    n = atoi(argv[1]);
+  if (n <= 0)
+  {
+    fprintf(2, "usage: dirbench [n]\n");
+    exit(1);
+  }
+
+  if (mkdir("dirbench.d") < 0 || chdir("dirbench.d") < 0)
+  {
+    fprintf(2, "dirbench: cannot make dirbench.d\n");
+    exit(1);
+  }
+
+  t0 = uptime();
+  for (i = 0; i < n; i++)
+  {
+    fname(name, i);
+    if ((fd = open(name, O_CREATE | O_RDWR)) < 0)
+    {
+      fprintf(2, "dirbench: create %s failed; using %d files\n", name, i);
+      n = i;
+      break;
+    }
+    close(fd);
+  }
+  t1 = uptime();
+
+  // look them up in a different order than they were made.
+  for (i = n - 1; i >= 0; i--)
+  {
+    fname(name, i);
+    if ((fd = open(name, O_RDONLY)) < 0)
+    {
+      fprintf(2, "dirbench: open %s failed\n", name);
+      exit(1);
+    }
+    close(fd);
+  }
+  t2 = uptime();
+
+  for (i = 0; i < n; i++)
+  {
+    fname(name, i);
+    if (unlink(name) < 0)
+    {
+      fprintf(2, "dirbench: unlink %s failed\n", name);
+      exit(1);
+    }
+  }
+  t3 = uptime();
+
+  chdir("..");
+  if (unlink("dirbench.d") < 0)
+    fprintf(2, "dirbench: cannot remove dirbench.d\n");
+
+  printf("%d files: create %d ticks, lookup %d ticks, unlink %d ticks\n",
+         n, t1 - t0, t2 - t1, t3 - t2);
+  exit(0);
+}
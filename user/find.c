@@ -5,6 +5,8 @@
 #include "kernel/fcntl.h"
 #include "user/match.c"
 
+#define NENT 32 // directory entries per getdents()
+
 void find(char *path, char *filename);
 
 char *get_basename(char *path)
@@ -40,12 +42,31 @@ int main(int argc, char *argv[])
     exit(0);
 }
 
+// does the name match filename, which may be a pattern?
+int matches(char *name, char *filename)
+{
+    // check if filename contains regex characters
+    int is_regex = 0;
+    for (char *p = filename; *p != '\0'; p++)
+    {
+        if (*p == '^' || *p == '$' || *p == '.' || *p == '*')
+        {
+            is_regex = 1;
+            break;
+        }
+    }
+
+    if (is_regex)
+        return match(filename, name);
+    return strcmp(filename, name) == 0;
+}
+
 void find(char *path, char *filename)
 {
     char buf[512], *p;
-    int fd;
+    int fd, i, n;
     struct stat st;
-    struct dirent de;
+    struct dirstat *ents, *de;
 
     if ((fd = open(path, O_RDONLY)) < 0)
     {
@@ -63,30 +84,7 @@ void find(char *path, char *filename)
     switch (st.type)
     {
     case T_FILE:
-        char *basename = get_basename(path);
-
-        // check if filename contains regex characters
-        int is_regex = 0;
-        for (char *p = filename; *p != '\0'; p++)
-        {
-            if (*p == '^' || *p == '$' || *p == '.' || *p == '*')
-            {
-                is_regex = 1;
-                break;
-            }
-        }
-
-        int found;
-        if (is_regex)
-        {
-            found = match(filename, basename);
-        }
-        else
-        {
-            found = (strcmp(filename, basename) == 0);
-        }
-
-        if (found)
+        if (matches(get_basename(path), filename))
         {
             printf("%s\n", path);
         }
@@ -101,21 +99,29 @@ void find(char *path, char *filename)
         p = buf + strlen(buf);
         *p++ = '/';
 
-        while (read(fd, &de, sizeof(de)) == sizeof(de))
+        // read the entries in batches, with their types, so
+        // that files needn't be opened; on the heap, since
+        // find recurses.
+        if ((ents = malloc(NENT * sizeof(*ents))) == 0)
         {
-            if (de.inum == 0)
-                continue;
-            if (strcmp(de.name, ".") == 0 || strcmp(de.name, "..") == 0)
-                continue;
-
-            int namelen = strlen(de.name);
-            if (namelen > DIRSIZ)
-                namelen = DIRSIZ;
-            memmove(p, de.name, DIRSIZ);
-            p[DIRSIZ] = 0;
-
-            find(buf, filename);
+            fprintf(2, "find: out of memory\n");
+            break;
+        }
+        while ((n = getdents(fd, ents, NENT, GD_STAT)) > 0)
+        {
+            for (i = 0; i < n; i++)
+            {
+                de = &ents[i];
+                if (strcmp(de->name, ".") == 0 || strcmp(de->name, "..") == 0)
+                    continue;
+                strcpy(p, de->name);
+                if (de->type == T_DIR)
+                    find(buf, filename);
+                else if (de->type == T_FILE && matches(de->name, filename))
+                    printf("%s\n", buf);
+            }
         }
+        free(ents);
     }
 
     close(fd);
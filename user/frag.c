@@ -0,0 +1,154 @@
+// frag: report how fragmented files are on disk.
+//
+//   frag [path ...]   report each file, or each file in each directory
+//   frag -t           append to several files at once, in turns,
+//                     then report them (and remove them)
+//
+// an extent is a run of a file's blocks that are contiguous on disk.
+// one extent per file is ideal.
+
+#include "kernel/types.h"
+#include "kernel/stat.h"
+#include "user/user.h"
+#include "kernel/fs.h"
+#include "kernel/fcntl.h"
+
+#define NTEST 4       // files written by -t
+#define TESTBLOCKS 40 // blocks in each of them
+
+int nfiles, nblocks, nextents;
+
+// report on the open regular file fd.
+void frag(int fd, char *name, int size)
+{
+  int bn, n, addr, prev, extents;
+
+  n = (size + BSIZE - 1) / BSIZE;
+  extents = 0;
+  prev = -1;
+  for (bn = 0; bn < n; bn++)
+  {
+    if ((addr = fmap(fd, bn)) <= 0)
+      continue; // a hole
+    if (addr != prev + 1)
+      extents++;
+    prev = addr;
+  }
+  printf("%s: %d blocks, %d extents\n", name, n, extents);
+  nfiles++;
+  nblocks += n;
+  nextents += extents;
+}
+
+void report(char *path)
+{
+  char buf[512], *p;
+  int fd, fd1;
+  struct dirent de;
+  struct stat st;
+
+  if ((fd = open(path, O_RDONLY)) < 0)
+  {
+    fprintf(2, "frag: cannot open %s\n", path);
+    return;
+  }
+  if (fstat(fd, &st) < 0)
+  {
+    fprintf(2, "frag: cannot stat %s\n", path);
+    close(fd);
+    return;
+  }
+
+  switch (st.type)
+  {
+  case T_FILE:
+    frag(fd, path, st.size);
+    break;
+
+  case T_DIR:
+    if (strlen(path) + 1 + DIRSIZ + 1 > sizeof buf)
+    {
+      printf("frag: path too long\n");
+      break;
+    }
+    strcpy(buf, path);
+    p = buf + strlen(buf);
+    *p++ = '/';
+    while (read(fd, &de, sizeof(de)) == sizeof(de))
+    {
+      if (de.inum == 0)
+        continue;
+      memmove(p, de.name, DIRSIZ);
+      p[DIRSIZ] = 0;
+      if ((fd1 = open(buf, O_RDONLY)) < 0)
+        continue;
+      if (fstat(fd1, &st) == 0 && st.type == T_FILE)
+        frag(fd1, buf, st.size);
+      close(fd1);
+    }
+    break;
+  }
+  close(fd);
+}
+
+// write NTEST files a block at a time, taking turns, the way
+// concurrent appenders (logs, downloads) do.
+void test(void)
+{
+  char name[8], data[BSIZE];
+  int fds[NTEST];
+  int i, j;
+
+  memset(data, 'f', sizeof(data));
+  for (i = 0; i < NTEST; i++)
+  {
+    name[0] = 'f';
+    name[1] = 'r';
+    name[2] = 'a';
+    name[3] = 'g';
+    name[4] = '0' + i;
+    name[5] = 0;
+    if ((fds[i] = open(name, O_CREATE | O_TRUNC | O_RDWR)) < 0)
+    {
+      fprintf(2, "frag: cannot create %s\n", name);
+      exit(1);
+    }
+  }
+  for (j = 0; j < TESTBLOCKS; j++)
+  {
+    for (i = 0; i < NTEST; i++)
+    {
+      if (write(fds[i], data, sizeof(data)) != sizeof(data))
+      {
+        fprintf(2, "frag: write failed\n");
+        exit(1);
+      }
+    }
+  }
+  for (i = 0; i < NTEST; i++)
+  {
+    name[4] = '0' + i;
+    frag(fds[i], name, TESTBLOCKS * BSIZE);
+    close(fds[i]);
+    unlink(name);
+  }
+}
+
+int main(int argc, char *argv[])
+{
+  int i;
+
+  if (argc == 2 && strcmp(argv[1], "-t") == 0)
+    test();
+  else if (argc < 2)
+    report(".");
+  else
+    for (i = 1; i < argc; i++)
+      report(argv[i]);
+
+  if (nextents > 0)
+    printf("%d files, %d blocks, %d extents, %d.%d%d blocks per extent\n",
+           nfiles, nblocks, nextents, nblocks / nextents,
+           nblocks * 10 / nextents % 10, nblocks * 100 / nextents % 10);
+  exit(0);
+}
@@ -18,6 +18,7 @@ int main(void)
   if (open("console", O_RDWR) < 0)
   {
     mknod("console", CONSOLE, 0);
+    mknod("statistics", STATS, 0);
     open("console", O_RDWR);
   }
   dup(0); // stdout
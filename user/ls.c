@@ -4,6 +4,10 @@
 #include "kernel/fs.h"
 #include "kernel/fcntl.h"
 
+#define NENT 32 // directory entries per getdents()
+
+struct dirstat ents[NENT];
+
 char *
 fmtname(char *path)
 {
@@ -25,9 +29,8 @@ fmtname(char *path)
 
 void ls(char *path)
 {
-  char buf[512], *p;
-  int fd;
-  struct dirent de;
+  int fd, i, n;
+  struct dirstat *de;
   struct stat st;
 
   if ((fd = open(path, O_RDONLY)) < 0)
@@ -51,26 +54,15 @@ void ls(char *path)
     break;
 
   case T_DIR:
-    if (strlen(path) + 1 + DIRSIZ + 1 > sizeof buf)
-    {
-      printf("ls: path too long\n");
-      break;
-    }
-    strcpy(buf, path);
-    p = buf + strlen(buf);
-    *p++ = '/';
-    while (read(fd, &de, sizeof(de)) == sizeof(de))
+    // the entries come with their types and sizes, so
+    // there's no need to stat() each one.
+    while ((n = getdents(fd, ents, NENT, GD_STAT)) > 0)
     {
-      if (de.inum == 0)
-        continue;
-      memmove(p, de.name, DIRSIZ);
-      p[DIRSIZ] = 0;
-      if (stat(buf, &st) < 0)
+      for (i = 0; i < n; i++)
       {
-        printf("ls: cannot stat %s\n", buf);
-        continue;
+        de = &ents[i];
+        printf("%s %d %d %d\n", fmtname(de->name), de->type, de->inum, de->size);
       }
-      printf("%s %d %d %d\n", fmtname(buf), st.type, st.ino, (int)st.size);
     }
     break;
   }
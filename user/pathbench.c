@@ -0,0 +1,95 @@
+// pathbench: time path lookups through a deep directory tree,
+// of a name that exists and of one that doesn't.
+//
+//   pathbench [n]    open each path n times; the default is 1000.
+//
+// times are in clock ticks, from uptime(). run stats afterwards
+// to see the directory entry cache's hit rate.
+
+#include "kernel/types.h"
+#include "kernel/stat.h"
+#include "user/user.h"
+#include "kernel/fcntl.h"
+
+#define DEPTH 8
+
+char path[64];
+
+// time n opens of path; want is whether it should exist.
+int bench(int n, int want)
+{
+  int i, fd, t0;
+
+  t0 = uptime();
+  for (i = 0; i < n; i++)
+  {
+    fd = open(path, O_RDONLY);
+    if ((fd >= 0) != want)
+    {
+      fprintf(2, "pathbench: open %s: %d\n", path, fd);
+      exit(1);
+    }
+    if (fd >= 0)
+      close(fd);
+  }
+  return uptime() - t0;
+}
+
+int main(int argc, char *argv[])
+{
+  int n = 1000;
+  int i, fd, len, hit, miss;
+
+  if (argc > 1)
+    n = atoi(argv[1]);
+  if (n <= 0)
+  {
+    fprintf(2, "usage: pathbench [n]\n");
+    exit(1);
+  }
+
+  // pb.d/a/b/c/.../file
+  strcpy(path, "pb.d");
+  len = strlen(path);
+  if (mkdir(path) < 0)
+  {
+    fprintf(2, "pathbench: cannot make %s\n", path);
+    exit(1);
+  }
+  for (i = 0; i < DEPTH; i++)
+  {
+    path[len++] = '/';
+    path[len++] = 'a' + i;
+    path[len] = 0;
+    if (mkdir(path) < 0)
+    {
+      fprintf(2, "pathbench: cannot make %s\n", path);
+      exit(1);
+    }
+  }
+  strcpy(path + len, "/file");
+  if ((fd = open(path, O_CREATE | O_RDWR)) < 0)
+  {
+    fprintf(2, "pathbench: cannot create %s\n", path);
+    exit(1);
+  }
+  close(fd);
+
+  hit = bench(n, 1);
+  strcpy(path + len, "/nofile");
+  miss = bench(n, 0);
+
+  printf("%d lookups of a %d-deep path: %d ticks; of a missing name: %d ticks\n",
+         n, DEPTH + 2, hit, miss);
+
+  strcpy(path + len, "/file");
+  unlink(path);
+  while (len > 4)
+  {
+    path[len] = 0;
+    unlink(path);
+    len -= 2;
+  }
+  unlink("pb.d");
+  exit(0);
+}
@@ -0,0 +1,108 @@
+// pipebench: pipe throughput for several write sizes. a child
+// writes, the parent reads and checks what arrives.
+//
+//   pipebench [kb [size]]   move kb KB through a pipe for each
+//                           write size; the default is 1024 KB.
+//                           size sets the pipe's buffer size.
+//
+// times are in clock ticks, from uptime(); a tick is about
+// 1/10th of a second under qemu, which is what KB/s assumes.
+
+#include "kernel/types.h"
+#include "kernel/stat.h"
+#include "user/user.h"
+#include "kernel/fcntl.h"
+
+#define RBUF 4096 // bytes per read()
+
+char buf[RBUF];
+int psize; // pipe buffer size, 0 for the default
+
+void bench(int wsize, int kb)
+{
+  int fds[2], i, n, pid, t0, t, total, size;
+  uint sum, want;
+
+  total = kb * 1024;
+  if (pipe(fds) < 0)
+  {
+    fprintf(2, "pipebench: pipe failed\n");
+    exit(1);
+  }
+  if (psize && fcntl(fds[0], F_SETPIPE_SZ, psize) < 0)
+  {
+    fprintf(2, "pipebench: cannot set pipe size %d\n", psize);
+    exit(1);
+  }
+  size = fcntl(fds[0], F_GETPIPE_SZ, 0);
+
+  t0 = uptime();
+  pid = fork();
+  if (pid < 0)
+  {
+    fprintf(2, "pipebench: fork failed\n");
+    exit(1);
+  }
+  if (pid == 0)
+  {
+    close(fds[0]);
+    for (i = 0; i < wsize; i++)
+      buf[i] = i;
+    for (i = 0; i < total; i += n)
+    {
+      n = total - i < wsize ? total - i : wsize;
+      if (write(fds[1], buf, n) != n)
+      {
+        fprintf(2, "pipebench: write failed at %d\n", i);
+        exit(1);
+      }
+    }
+    exit(0);
+  }
+
+  close(fds[1]);
+  sum = want = 0;
+  for (i = 0; (n = read(fds[0], buf, RBUF)) > 0; i += n)
+  {
+    while (n-- > 0)
+      sum += (uchar)buf[n];
+  }
+  t = uptime() - t0;
+  close(fds[0]);
+  wait(0);
+
+  for (n = 0; n < total; n++)
+    want += (uchar)(n % wsize);
+  if (i != total || sum != want)
+  {
+    fprintf(2, "pipebench: read %d bytes of %d, sum %d, want %d\n",
+            i, total, sum, want);
+    exit(1);
+  }
+
+  if (t == 0)
+    t = 1;
+  printf("%d-byte writes, %d-byte pipe: %d KB in %d ticks, %d KB/s\n",
+         wsize, size, kb, t, kb * 10 / t);
+}
+
+int main(int argc, char *argv[])
+{
+  int kb = 1024;
+
+  if (argc > 1)
+    kb = atoi(argv[1]);
+  if (kb <= 0)
+  {
+    fprintf(2, "usage: pipebench [kb [size]]\n");
+    exit(1);
+  }
+  if (argc > 2)
+    psize = atoi(argv[2]);
+
+  bench(1, kb);
+  bench(64, kb);
+  bench(512, kb);
+  bench(4096, kb);
+  exit(0);
+}
@@ -1,19 +1,72 @@
 #include "kernel/types.h"
 #include "kernel/stat.h"
 #include "user/user.h"
+#include "kernel/fcntl.h"
 
 #include <stdarg.h>
 
 static char digits[] = "0123456789ABCDEF";
 
+#define NOUT 64 // bytes of characters and digits per writev()
+
+// output of one printf call, which goes out with a single
+// writev() (or a few, for long output): runs of the format
+// string and %s strings in place, other characters copied
+// into buf.
+struct out
+{
+  int fd;
+  struct iovec iov[IOV_MAX];
+  int n; // entries of iov in use
+  char buf[NOUT];
+  int len; // bytes of buf in use
+};
+
+static void
+flush(struct out *o)
+{
+  if (o->n > 0)
+    writev(o->fd, o->iov, o->n);
+  o->n = 0;
+  o->len = 0;
+}
+
+// add the n bytes at s to the output, without copying them.
+static void
+putsn(struct out *o, const char *s, int n)
+{
+  struct iovec *v;
+
+  if (n == 0)
+    return;
+  if (o->n > 0)
+  {
+    v = &o->iov[o->n - 1];
+    if ((char *)v->iov_base + v->iov_len == s)
+    {
+      v->iov_len += n; // s continues the last buffer
+      return;
+    }
+  }
+  if (o->n == IOV_MAX)
+    flush(o);
+  o->iov[o->n].iov_base = (void *)s;
+  o->iov[o->n].iov_len = n;
+  o->n++;
+}
+
 static void
-putc(int fd, char c)
+putc(struct out *o, char c)
 {
-  write(fd, &c, 1);
+  if (o->len == NOUT || o->n == IOV_MAX)
+    flush(o);
+  o->buf[o->len] = c;
+  putsn(o, &o->buf[o->len], 1);
+  o->len++;
 }
 
 static void
-printint(int fd, int xx, int base, int sgn)
+printint(struct out *o, int xx, int base, int sgn)
 {
   char buf[16];
   int i, neg;
@@ -39,17 +92,17 @@ printint(int fd, int xx, int base, int sgn)
     buf[i++] = '-';
 
   while (--i >= 0)
-    putc(fd, buf[i]);
+    putc(o, buf[i]);
 }
 
 static void
-printptr(int fd, uint64 x)
+printptr(struct out *o, uint64 x)
 {
   int i;
-  putc(fd, '0');
-  putc(fd, 'x');
+  putc(o, '0');
+  putc(o, 'x');
   for (i = 0; i < (sizeof(uint64) * 2); i++, x <<= 4)
-    putc(fd, digits[x >> (sizeof(uint64) * 8 - 4)]);
+    putc(o, digits[x >> (sizeof(uint64) * 8 - 4)]);
 }
 
 // Print to the given fd. Only understands %d, %x, %p, %s.
@@ -57,7 +110,11 @@ void vprintf(int fd, const char *fmt, va_list ap)
 {
   char *s;
   int c0, c1, c2, i, state;
+  struct out o;
 
+  o.fd = fd;
+  o.n = 0;
+  o.len = 0;
   state = 0;
   for (i = 0; fmt[i]; i++)
   {
@@ -70,7 +127,7 @@ void vprintf(int fd, const char *fmt, va_list ap)
       }
       else
       {
-        putc(fd, c0);
+        putsn(&o, fmt + i, 1);
       }
     }
     else if (state == '%')
@@ -82,66 +139,65 @@ void vprintf(int fd, const char *fmt, va_list ap)
         c2 = fmt[i + 2] & 0xff;
       if (c0 == 'd')
       {
-        printint(fd, va_arg(ap, int), 10, 1);
+        printint(&o, va_arg(ap, int), 10, 1);
       }
       else if (c0 == 'l' && c1 == 'd')
       {
-        printint(fd, va_arg(ap, uint64), 10, 1);
+        printint(&o, va_arg(ap, uint64), 10, 1);
         i += 1;
       }
       else if (c0 == 'l' && c1 == 'l' && c2 == 'd')
       {
-        printint(fd, va_arg(ap, uint64), 10, 1);
+        printint(&o, va_arg(ap, uint64), 10, 1);
         i += 2;
       }
       else if (c0 == 'u')
       {
-        printint(fd, va_arg(ap, int), 10, 0);
+        printint(&o, va_arg(ap, int), 10, 0);
       }
       else if (c0 == 'l' && c1 == 'u')
       {
-        printint(fd, va_arg(ap, uint64), 10, 0);
+        printint(&o, va_arg(ap, uint64), 10, 0);
         i += 1;
       }
       else if (c0 == 'l' && c1 == 'l' && c2 == 'u')
       {
-        printint(fd, va_arg(ap, uint64), 10, 0);
+        printint(&o, va_arg(ap, uint64), 10, 0);
         i += 2;
       }
       else if (c0 == 'x')
       {
-        printint(fd, va_arg(ap, int), 16, 0);
+        printint(&o, va_arg(ap, int), 16, 0);
       }
       else if (c0 == 'l' && c1 == 'x')
       {
-        printint(fd, va_arg(ap, uint64), 16, 0);
+        printint(&o, va_arg(ap, uint64), 16, 0);
         i += 1;
       }
       else if (c0 == 'l' && c1 == 'l' && c2 == 'x')
       {
-        printint(fd, va_arg(ap, uint64), 16, 0);
+        printint(&o, va_arg(ap, uint64), 16, 0);
         i += 2;
       }
       else if (c0 == 'p')
       {
-        printptr(fd, va_arg(ap, uint64));
+        printptr(&o, va_arg(ap, uint64));
       }
       else if (c0 == 's')
       {
         if ((s = va_arg(ap, char *)) == 0)
           s = "(null)";
-        for (; *s; s++)
-          putc(fd, *s);
+        putsn(&o, s, strlen(s));
       }
       else if (c0 == '%')
       {
-        putc(fd, '%');
+        putc(&o, '%');
       }
       else
       {
         // Unknown % sequence.  Print it to draw attention.
-        putc(fd, '%');
-        putc(fd, c0);
+        putc(&o, '%');
+        putc(&o, c0);
       }
 
 #if 0
@@ -174,6 +230,7 @@ void vprintf(int fd, const char *fmt, va_list ap)
       state = 0;
     }
   }
+  flush(&o);
 }
 
 void fprintf(int fd, const char *fmt, ...)
@@ -0,0 +1,110 @@
+// randbench: random-access I/O on one file, with lseek() plus
+// read()/write(), and with pread()/pwrite().
+//
+//   randbench [kb [n]]   make a kb-KB file (default 512), then do n
+//                        reads and n writes (default 2000) of one
+//                        block each, at random block offsets.
+//
+// times are in clock ticks, from uptime().
+
+#include "kernel/types.h"
+#include "kernel/stat.h"
+#include "user/user.h"
+#include "kernel/fs.h"
+#include "kernel/fcntl.h"
+
+char buf[BSIZE];
+unsigned long seed;
+
+// a linear congruential generator.
+int rand(void)
+{
+  seed = seed * 6364136223846793005UL + 1442695040888963407UL;
+  return (seed >> 33) & 0x7fffffff;
+}
+
+// n reads (or, if w, writes) of a block at random offsets;
+// seek says whether to lseek() and read()/write() or to use
+// pread()/pwrite().
+int bench(int fd, int nblocks, int n, int w, int seek)
+{
+  int i, off, r, t0;
+
+  seed = 1;
+  t0 = uptime();
+  for (i = 0; i < n; i++)
+  {
+    off = (rand() % nblocks) * BSIZE;
+    if (w)
+      ((int *)buf)[0] = off;
+    if (seek)
+    {
+      if (lseek(fd, off, SEEK_SET) != off)
+      {
+        fprintf(2, "randbench: lseek failed\n");
+        exit(1);
+      }
+      r = w ? write(fd, buf, BSIZE) : read(fd, buf, BSIZE);
+    }
+    else
+      r = w ? pwrite(fd, buf, BSIZE, off) : pread(fd, buf, BSIZE, off);
+    if (r != BSIZE)
+    {
+      fprintf(2, "randbench: %s at %d failed\n", w ? "write" : "read", off);
+      exit(1);
+    }
+    if (!w && ((int *)buf)[0] != off)
+    {
+      fprintf(2, "randbench: wrong data at %d\n", off);
+      exit(1);
+    }
+  }
+  return uptime() - t0;
+}
+
+int main(int argc, char *argv[])
+{
+  int kb = 512, n = 2000;
+  int fd, i, nblocks, t1, t2;
+
+  if (argc > 1)
+    kb = atoi(argv[1]);
+  if (argc > 2)
+    n = atoi(argv[2]);
+  if (kb <= 0 || n <= 0)
+  {
+    fprintf(2, "usage: randbench [kb [n]]\n");
+    exit(1);
+  }
+  nblocks = kb * 1024 / BSIZE;
+
+  // each block starts with its own offset, and
+  // writes put back what was there.
+  unlink("randbench.tmp");
+  fd = open("randbench.tmp", O_CREATE | O_RDWR);
+  if (fd < 0)
+  {
+    fprintf(2, "randbench: cannot create randbench.tmp\n");
+    exit(1);
+  }
+  for (i = 0; i < nblocks; i++)
+  {
+    ((int *)buf)[0] = i * BSIZE;
+    if (write(fd, buf, BSIZE) != BSIZE)
+    {
+      fprintf(2, "randbench: write failed\n");
+      exit(1);
+    }
+  }
+
+  t1 = bench(fd, nblocks, n, 0, 1);
+  t2 = bench(fd, nblocks, n, 0, 0);
+  printf("%d random reads: lseek+read %d ticks, pread %d ticks\n", n, t1, t2);
+  t1 = bench(fd, nblocks, n, 1, 1);
+  t2 = bench(fd, nblocks, n, 1, 0);
+  printf("%d random writes: lseek+write %d ticks, pwrite %d ticks\n", n, t1, t2);
+
+  close(fd);
+  unlink("randbench.tmp");
+  exit(0);
+}
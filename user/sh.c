@@ -20,7 +20,7 @@ int bg_count = 0; // Number of background jobs
 char *available_commands[] = {
     "cat", "cd", "clear", "echo", "forktest", "grep", "init", "kill", "ln",
     "ls", "mkdir", "rm", "rmdir", "sh", "stressfs", "usertests",
-    "wc", "zombie", "wait", "exit", "pwd", "sleep", "uptime"};
+    "wc", "zombie", "wait", "exit", "pwd", "sleep", "uptime", "stats", "frag", "bigbench", "dirbench", "pathbench", "pipebench", "randbench"};
 #define NUM_COMMANDS (sizeof(available_commands) / sizeof(available_commands[0]))
 
 void tab_completion(char *, int *, int);
@@ -177,22 +177,40 @@ void show_history_cmd(char *buf, int *index)
   write(2, buf, *index);
 }
 
-int getcmd(char *buf, int nbuf)
+// input read from the console but not yet used. in raw mode
+// a read() returns all that has been typed, up to the end of
+// the line, so a pasted command line arrives in one read(),
+// and what follows it is left for the command to read.
+char ibuf[64];
+int ipos, ilen;
+
+// the next input character; tty says whether stdin is the
+// console, in raw mode. returns -1 at end of input.
+int getch(char *c, int tty)
 {
-  // check that stdin is a terminal
-  struct stat st;
-  if (fstat(0, &st) >= 0 && st.type == T_DEVICE && st.dev == 1)
+  if (ipos == ilen)
   {
-    write(2, "hhh937@xv6$ ", 12);
+    ipos = 0;
+    if ((ilen = read(0, ibuf, tty ? sizeof(ibuf) : 1)) <= 0)
+    {
+      ilen = 0;
+      return -1;
+    }
   }
+  *c = ibuf[ipos++];
+  return 0;
+}
 
+// read and edit a command line into buf.
+int editcmd(char *buf, int nbuf, int tty)
+{
   memset(buf, 0, nbuf);
 
   int i = 0;
   char c;
   while (i < nbuf - 1)
   {
-    if (read(0, &c, 1) != 1)
+    if (getch(&c, tty) < 0)
     {
       break;
     }
@@ -226,9 +244,9 @@ int getcmd(char *buf, int nbuf)
     case ESC:
       // handle <escape> sequences (e.g., arrow keys)
       // read two more chars
-      if (read(0, &c, 1) == 1 && c == '[')
+      if (getch(&c, tty) == 0 && c == '[')
       {
-        if (read(0, &c, 1) == 1)
+        if (getch(&c, tty) == 0)
         {
           if (c == 'A') // up arrow
           {
@@ -261,6 +279,11 @@ int getcmd(char *buf, int nbuf)
       }
       break;
 
+    case 4: // control-d, end of file in raw mode
+      if (i == 0)
+        return -1;
+      break;
+
     default:
       // other control characters
       if (c >= ' ' && c <= '~')
@@ -284,6 +307,27 @@ int getcmd(char *buf, int nbuf)
   return 0;
 }
 
+int getcmd(char *buf, int nbuf)
+{
+  int tty, r;
+
+  // check that stdin is a terminal. if so, the line editor
+  // puts the console in raw mode, and back in cooked mode
+  // for the commands it runs.
+  struct stat st;
+  tty = fstat(0, &st) >= 0 && st.type == T_DEVICE && st.dev == 1 &&
+        ioctl(0, CIOCSMODE, CONS_RAW) == 0;
+  if (tty)
+  {
+    write(2, "hhh937@xv6$ ", 12);
+  }
+
+  r = editcmd(buf, nbuf, tty);
+  if (tty)
+    ioctl(0, CIOCSMODE, CONS_COOKED);
+  return r;
+}
+
 int main(void)
 {
   static char buf[100];
@@ -0,0 +1,33 @@
+// stats: print the kernel's counters, from the statistics device.
+
+#include "kernel/types.h"
+#include "kernel/stat.h"
+#include "kernel/spinlock.h"
+#include "kernel/sleeplock.h"
+#include "kernel/fs.h"
+#include "kernel/file.h"
+#include "user/user.h"
+#include "kernel/fcntl.h"
+
+char buf[512];
+
+int main(int argc, char *argv[])
+{
+  int fd, n;
+
+  if ((fd = open("/statistics", O_RDONLY)) < 0)
+  {
+    mknod("/statistics", STATS, 0);
+    if ((fd = open("/statistics", O_RDONLY)) < 0)
+    {
+      fprintf(2, "stats: cannot open /statistics\n");
+      exit(1);
+    }
+  }
+
+  while ((n = read(fd, buf, sizeof(buf))) > 0)
+    write(1, buf, n);
+  close(fd);
+
+  exit(0);
+}
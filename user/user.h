@@ -1,4 +1,8 @@
 struct stat;
+struct iovec;
+struct dirstat;
+struct pollfd;
+struct epoll_event;
 
 // system calls
 int fork(void);
@@ -22,6 +26,22 @@ int getpid(void);
 char *sbrk(int);
 int sleep(int);
 int uptime(void);
+int fsync(int);
+int fmap(int, int);
+int fcntl(int, int, int);
+int splice(int, int, int);
+int sendfile(int, int, int, int);
+int lseek(int, int, int);
+int pread(int, void *, int, int);
+int pwrite(int, const void *, int, int);
+int readv(int, struct iovec *, int);
+int writev(int, struct iovec *, int);
+int getdents(int, struct dirstat *, int, int);
+int poll(struct pollfd *, int, int);
+int epoll_create(void);
+int epoll_ctl(int, int, int, struct epoll_event *);
+int epoll_wait(int, struct epoll_event *, int, int);
+int ioctl(int, int, int);
 
 // ulib.c
 int stat(const char *, struct stat *);
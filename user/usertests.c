@@ -638,18 +638,185 @@ void writetest(char *s)
   }
 }
 
+// fsync() waits for the log to commit; it must
+// also reject file descriptors that aren't open.
+void fsynctest(char *s)
+{
+  int fd, i;
+
+  fd = open("fsyncf", O_CREATE | O_RDWR);
+  if (fd < 0)
+  {
+    printf("%s: error: creat fsyncf failed!\n", s);
+    exit(1);
+  }
+  for (i = 0; i < 10; i++)
+  {
+    if (write(fd, "aaaaaaaaaa", 10) != 10)
+    {
+      printf("%s: error: write fsyncf failed\n", s);
+      exit(1);
+    }
+    if (fsync(fd) != 0)
+    {
+      printf("%s: error: fsync failed\n", s);
+      exit(1);
+    }
+  }
+  close(fd);
+
+  if (fsync(fd) != -1)
+  {
+    printf("%s: error: fsync of closed fd succeeded\n", s);
+    exit(1);
+  }
+
+  fd = open("fsyncf", O_RDONLY);
+  if (fd < 0 || read(fd, buf, sizeof(buf)) != 100)
+  {
+    printf("%s: error: read fsyncf failed\n", s);
+    exit(1);
+  }
+  close(fd);
+
+  if (unlink("fsyncf") < 0)
+  {
+    printf("%s: unlink fsyncf failed\n", s);
+    exit(1);
+  }
+}
+
+// two files appended to in turns: every block is mapped,
+// and no disk block is shared between them.
+void fmaptest(char *s)
+{
+  int fd0, fd1, i, j, a0[20], a1[20];
+
+  fd0 = open("fmap0", O_CREATE | O_RDWR);
+  fd1 = open("fmap1", O_CREATE | O_RDWR);
+  if (fd0 < 0 || fd1 < 0)
+  {
+    printf("%s: error: creat fmap failed!\n", s);
+    exit(1);
+  }
+  memset(buf, 'm', BSIZE);
+  for (i = 0; i < 20; i++)
+  {
+    if (write(fd0, buf, BSIZE) != BSIZE || write(fd1, buf, BSIZE) != BSIZE)
+    {
+      printf("%s: error: write fmap failed\n", s);
+      exit(1);
+    }
+  }
+  for (i = 0; i < 20; i++)
+  {
+    a0[i] = fmap(fd0, i);
+    a1[i] = fmap(fd1, i);
+    if (a0[i] <= 0 || a1[i] <= 0)
+    {
+      printf("%s: error: fmap block %d: %d %d\n", s, i, a0[i], a1[i]);
+      exit(1);
+    }
+  }
+  for (i = 0; i < 20; i++)
+  {
+    for (j = 0; j < 20; j++)
+    {
+      if (a0[i] == a1[j] || (i != j && (a0[i] == a0[j] || a1[i] == a1[j])))
+      {
+        printf("%s: error: fmap block %d shared\n", s, a0[i]);
+        exit(1);
+      }
+    }
+  }
+  if (fmap(fd0, 20) != 0)
+  {
+    printf("%s: error: fmap past end\n", s);
+    exit(1);
+  }
+  close(fd0);
+  close(fd1);
+  if (fmap(fd0, 0) != -1)
+  {
+    printf("%s: error: fmap of closed fd succeeded\n", s);
+    exit(1);
+  }
+  unlink("fmap0");
+  unlink("fmap1");
+}
+
+// a tiny file lives in its inode, and moves out to a block
+// of its own as it grows.
+void inlinetest(char *s)
+{
+  int fd, i;
+
+  fd = open("inline", O_CREATE | O_RDWR);
+  if (fd < 0)
+  {
+    printf("%s: error: creat inline failed!\n", s);
+    exit(1);
+  }
+  for (i = 0; i < 120; i++)
+    buf[i] = 'a' + i % 26;
+  if (write(fd, buf, 10) != 10 || write(fd, buf + 10, 10) != 10)
+  {
+    printf("%s: error: write inline failed\n", s);
+    exit(1);
+  }
+  if (fmap(fd, 0) != 0)
+  {
+    printf("%s: error: 20-byte file has a block\n", s);
+    exit(1);
+  }
+  if (write(fd, buf + 20, 100) != 100)
+  {
+    printf("%s: error: write inline failed\n", s);
+    exit(1);
+  }
+  if (fmap(fd, 0) <= 0)
+  {
+    printf("%s: error: 120-byte file has no block\n", s);
+    exit(1);
+  }
+  close(fd);
+
+  fd = open("inline", O_RDONLY);
+  memset(buf + 200, 0, 200);
+  if (read(fd, buf + 200, 200) != 120 || memcmp(buf, buf + 200, 120) != 0)
+  {
+    printf("%s: error: inline data lost\n", s);
+    exit(1);
+  }
+  close(fd);
+
+  fd = open("inline", O_RDWR | O_TRUNC);
+  if (write(fd, "xyz", 3) != 3 || fmap(fd, 0) != 0)
+  {
+    printf("%s: error: truncated file not inline\n", s);
+    exit(1);
+  }
+  close(fd);
+  unlink("inline");
+}
+
+// a block-mapped file that reaches into the doubly-indirect blocks.
 void writebig(char *s)
 {
+  enum
+  {
+    N = NDIRECT + NINDIRECT + 100
+  };
   int i, fd, n;
 
-  fd = open("big", O_CREATE | O_RDWR);
+  fd = open("big", O_CREATE | O_RDWR | O_BLOCKMAP);
   if (fd < 0)
   {
     printf("%s: error: creat big failed!\n", s);
     exit(1);
   }
 
-  for (i = 0; i < MAXFILE; i++)
+  for (i = 0; i < N; i++)
   {
     ((int *)buf)[0] = i;
     if (write(fd, buf, BSIZE) != BSIZE)
@@ -674,7 +841,7 @@ void writebig(char *s)
     i = read(fd, buf, BSIZE);
     if (i == 0)
     {
-      if (n != MAXFILE)
+      if (n != N)
       {
         printf("%s: read only %d blocks from big", s, n);
         exit(1);
@@ -702,6 +869,62 @@ void writebig(char *s)
   }
 }
 
+// new files are extent-mapped, and can grow past the old
+// singly-indirect limit of OLDMAXFILE blocks.
+void writehuge(char *s)
+{
+  enum
+  {
+    OLDMAXFILE = 12 + NINDIRECT,
+    N = OLDMAXFILE + 100
+  };
+  int i, fd, n;
+
+  fd = open("huge", O_CREATE | O_RDWR);
+  if (fd < 0)
+  {
+    printf("%s: error: creat huge failed!\n", s);
+    exit(1);
+  }
+  for (i = 0; i < N; i++)
+  {
+    ((int *)buf)[0] = i;
+    if (write(fd, buf, BSIZE) != BSIZE)
+    {
+      printf("%s: error: write huge file failed i=%d\n", s, i);
+      exit(1);
+    }
+  }
+  close(fd);
+
+  fd = open("huge", O_RDONLY);
+  if (fd < 0)
+  {
+    printf("%s: error: open huge failed!\n", s);
+    exit(1);
+  }
+  for (n = 0; (i = read(fd, buf, BSIZE)) == BSIZE; n++)
+  {
+    if (((int *)buf)[0] != n)
+    {
+      printf("%s: read content of block %d is %d\n", s,
+             n, ((int *)buf)[0]);
+      exit(1);
+    }
+  }
+  if (i != 0 || n != N)
+  {
+    printf("%s: read %d blocks from huge, then %d\n", s, n, i);
+    exit(1);
+  }
+  close(fd);
+  if (unlink("huge") < 0)
+  {
+    printf("%s: unlink huge failed\n", s);
+    exit(1);
+  }
+}
+
 // many creates, followed by unlink test
 void createtest(char *s)
 {
@@ -736,156 +959,1133 @@ void dirtest(char *s)
     printf("%s: mkdir failed\n", s);
     exit(1);
   }
-
-  if (chdir("dir0") < 0)
+
+  if (chdir("dir0") < 0)
+  {
+    printf("%s: chdir dir0 failed\n", s);
+    exit(1);
+  }
+
+  if (chdir("..") < 0)
+  {
+    printf("%s: chdir .. failed\n", s);
+    exit(1);
+  }
+
+  if (unlink("dir0") < 0)
+  {
+    printf("%s: unlink dir0 failed\n", s);
+    exit(1);
+  }
+}
+
+// a directory big enough to be indexed still reads as a plain
+// array of entries, and can be emptied and removed.
+void dirindex(char *s)
+{
+  enum
+  {
+    N = 150
+  };
+  char name[16];
+  struct dirent de;
+  int i, fd, n;
+
+  if (mkdir("dix") < 0 || (fd = open("dix/f", O_CREATE | O_RDWR)) < 0)
+  {
+    printf("%s: mkdir dix failed\n", s);
+    exit(1);
+  }
+  close(fd);
+  memmove(name, "dix/l", 5);
+  name[8] = 0;
+  for (i = 0; i < N; i++)
+  {
+    name[5] = '0' + i / 100;
+    name[6] = '0' + (i / 10) % 10;
+    name[7] = '0' + i % 10;
+    if (link("dix/f", name) != 0)
+    {
+      printf("%s: link %s failed\n", s, name);
+      exit(1);
+    }
+  }
+
+  fd = open("dix", O_RDONLY);
+  n = 0;
+  while (read(fd, &de, sizeof(de)) == sizeof(de))
+    if (de.inum != 0)
+      n++;
+  close(fd);
+  if (n != N + 3)
+  {
+    printf("%s: dix has %d entries, want %d\n", s, n, N + 3);
+    exit(1);
+  }
+
+  for (i = N - 1; i >= 0; i--)
+  {
+    name[5] = '0' + i / 100;
+    name[6] = '0' + (i / 10) % 10;
+    name[7] = '0' + i % 10;
+    if ((fd = open(name, O_RDONLY)) < 0 || close(fd) < 0 || unlink(name) != 0)
+    {
+      printf("%s: open/unlink %s failed\n", s, name);
+      exit(1);
+    }
+  }
+  if (unlink("dix") == 0)
+  {
+    printf("%s: unlink non-empty dix succeeded\n", s);
+    exit(1);
+  }
+  if (unlink("dix/f") != 0 || unlink("dix") != 0)
+  {
+    printf("%s: unlink dix failed\n", s);
+    exit(1);
+  }
+}
+
+// the directory entry cache must follow creates and unlinks,
+// including of a directory that is removed and made again.
+void dcachetest(char *s)
+{
+  int fd, i;
+
+  for (i = 0; i < 2; i++)
+  {
+    if (mkdir("dcd") < 0)
+    {
+      printf("%s: mkdir dcd failed\n", s);
+      exit(1);
+    }
+    if (open("dcd/x", O_RDONLY) >= 0)
+    {
+      printf("%s: open of missing dcd/x succeeded\n", s);
+      exit(1);
+    }
+    if ((fd = open("dcd/x", O_CREATE | O_RDWR)) < 0)
+    {
+      printf("%s: create dcd/x failed\n", s);
+      exit(1);
+    }
+    close(fd);
+    if ((fd = open("dcd/x", O_RDONLY)) < 0)
+    {
+      printf("%s: open dcd/x failed\n", s);
+      exit(1);
+    }
+    close(fd);
+    if (unlink("dcd/x") < 0 || open("dcd/x", O_RDONLY) >= 0)
+    {
+      printf("%s: dcd/x still there after unlink\n", s);
+      exit(1);
+    }
+    if (unlink("dcd") < 0)
+    {
+      printf("%s: unlink dcd failed\n", s);
+      exit(1);
+    }
+    if (open("dcd", O_RDONLY) >= 0)
+    {
+      printf("%s: dcd still there after unlink\n", s);
+      exit(1);
+    }
+  }
+}
+
+void exectest(char *s)
+{
+  int fd, xstatus, pid;
+  char *echoargv[] = {"echo", "OK", 0};
+  char buf[3];
+
+  unlink("echo-ok");
+  pid = fork();
+  if (pid < 0)
+  {
+    printf("%s: fork failed\n", s);
+    exit(1);
+  }
+  if (pid == 0)
+  {
+    close(1);
+    fd = open("echo-ok", O_CREATE | O_WRONLY);
+    if (fd < 0)
+    {
+      printf("%s: create failed\n", s);
+      exit(1);
+    }
+    if (fd != 1)
+    {
+      printf("%s: wrong fd\n", s);
+      exit(1);
+    }
+    if (exec("echo", echoargv) < 0)
+    {
+      printf("%s: exec echo failed\n", s);
+      exit(1);
+    }
+    // won't get to here
+  }
+  if (wait(&xstatus) != pid)
+  {
+    printf("%s: wait failed!\n", s);
+  }
+  if (xstatus != 0)
+    exit(xstatus);
+
+  fd = open("echo-ok", O_RDONLY);
+  if (fd < 0)
+  {
+    printf("%s: open failed\n", s);
+    exit(1);
+  }
+  if (read(fd, buf, 2) != 2)
+  {
+    printf("%s: read failed\n", s);
+    exit(1);
+  }
+  unlink("echo-ok");
+  if (buf[0] == 'O' && buf[1] == 'K')
+    exit(0);
+  else
+  {
+    printf("%s: wrong output\n", s);
+    exit(1);
+  }
+}
+
+// simple fork and pipe read/write
+
+void pipe1(char *s)
+{
+  int fds[2], pid, xstatus;
+  int seq, i, n, cc, total;
+  enum
+  {
+    N = 5,
+    SZ = 1033
+  };
+
+  if (pipe(fds) != 0)
+  {
+    printf("%s: pipe() failed\n", s);
+    exit(1);
+  }
+  pid = fork();
+  seq = 0;
+  if (pid == 0)
+  {
+    close(fds[0]);
+    for (n = 0; n < N; n++)
+    {
+      for (i = 0; i < SZ; i++)
+        buf[i] = seq++;
+      if (write(fds[1], buf, SZ) != SZ)
+      {
+        printf("%s: pipe1 oops 1\n", s);
+        exit(1);
+      }
+    }
+    exit(0);
+  }
+  else if (pid > 0)
+  {
+    close(fds[1]);
+    total = 0;
+    cc = 1;
+    while ((n = read(fds[0], buf, cc)) > 0)
+    {
+      for (i = 0; i < n; i++)
+      {
+        if ((buf[i] & 0xff) != (seq++ & 0xff))
+        {
+          printf("%s: pipe1 oops 2\n", s);
+          return;
+        }
+      }
+      total += n;
+      cc = cc * 2;
+      if (cc > sizeof(buf))
+        cc = sizeof(buf);
+    }
+    if (total != N * SZ)
+    {
+      printf("%s: pipe1 oops 3 total %d\n", s, total);
+      exit(1);
+    }
+    close(fds[0]);
+    wait(&xstatus);
+    exit(xstatus);
+  }
+  else
+  {
+    printf("%s: fork() failed\n", s);
+    exit(1);
+  }
+}
+
+// pipe buffer sizes: the default holds a page, a bigger buffer
+// holds a whole write without a reader, and shrinking fails
+// while the data would not fit.
+void pipesize(char *s)
+{
+  int fds[2], pid, xstatus, i, n, total;
+
+  if (pipe(fds) != 0)
+  {
+    printf("%s: pipe() failed\n", s);
+    exit(1);
+  }
+  if (fcntl(fds[0], F_GETPIPE_SZ, 0) != PGSIZE)
+  {
+    printf("%s: default pipe size %d\n", s, fcntl(fds[0], F_GETPIPE_SZ, 0));
+    exit(1);
+  }
+  if (fcntl(fds[1], F_SETPIPE_SZ, 5000) != 8192)
+  {
+    printf("%s: F_SETPIPE_SZ did not round 5000 up to 8192\n", s);
+    exit(1);
+  }
+  for (i = 0; i < 8192; i++)
+    buf[i] = i * 3;
+  // no reader is running, so this would block if the
+  // buffer were smaller.
+  if (write(fds[1], buf, 8192) != 8192)
+  {
+    printf("%s: write to big pipe failed\n", s);
+    exit(1);
+  }
+  if (fcntl(fds[1], F_SETPIPE_SZ, 512) != -1)
+  {
+    printf("%s: shrank a pipe below what it holds\n", s);
+    exit(1);
+  }
+  if (fcntl(fds[1], F_SETPIPE_SZ, 64 * PGSIZE) != -1)
+  {
+    printf("%s: F_SETPIPE_SZ allowed a huge buffer\n", s);
+    exit(1);
+  }
+  memset(buf, 0, 8192);
+  if (read(fds[0], buf, 4000) != 4000)
+  {
+    printf("%s: read from big pipe failed\n", s);
+    exit(1);
+  }
+  // the rest now fits in 4096 bytes.
+  if (fcntl(fds[0], F_SETPIPE_SZ, 4096) != 4096)
+  {
+    printf("%s: could not shrink pipe\n", s);
+    exit(1);
+  }
+  if (read(fds[0], buf + 4000, 8192) != 8192 - 4000)
+  {
+    printf("%s: short read after shrinking\n", s);
+    exit(1);
+  }
+  for (i = 0; i < 8192; i++)
+  {
+    if (buf[i] != (char)(i * 3))
+    {
+      printf("%s: wrong data at %d\n", s, i);
+      exit(1);
+    }
+  }
+
+  // a small buffer still passes lots of data.
+  if (fcntl(fds[0], F_SETPIPE_SZ, 512) != 512)
+  {
+    printf("%s: could not make a 512-byte pipe\n", s);
+    exit(1);
+  }
+  pid = fork();
+  if (pid < 0)
+  {
+    printf("%s: fork() failed\n", s);
+    exit(1);
+  }
+  if (pid == 0)
+  {
+    close(fds[0]);
+    for (i = 0; i < 8192; i++)
+      buf[i] = i;
+    for (i = 0; i < 10; i++)
+    {
+      if (write(fds[1], buf, 8192) != 8192)
+        exit(1);
+    }
+    exit(0);
+  }
+  close(fds[1]);
+  total = 0;
+  while ((n = read(fds[0], buf, 3000)) > 0)
+  {
+    for (i = 0; i < n; i++)
+    {
+      if (buf[i] != (char)((total + i) % 8192))
+      {
+        printf("%s: wrong data at %d\n", s, total + i);
+        exit(1);
+      }
+    }
+    total += n;
+  }
+  close(fds[0]);
+  wait(&xstatus);
+  if (total != 10 * 8192 || xstatus != 0)
+  {
+    printf("%s: read %d bytes, writer status %d\n", s, total, xstatus);
+    exit(1);
+  }
+}
+
+// splice() and sendfile() move data between files and pipes
+// inside the kernel.
+void splicetest(char *s)
+{
+  int fd, out, fds[2], i, n;
+  enum
+  {
+    SZ = 6000
+  };
+
+  unlink("splice.in");
+  unlink("splice.out");
+  fd = open("splice.in", O_CREATE | O_RDWR);
+  if (fd < 0)
+  {
+    printf("%s: create splice.in failed\n", s);
+    exit(1);
+  }
+  for (i = 0; i < SZ; i++)
+    buf[i] = i * 5;
+  if (write(fd, buf, SZ) != SZ)
+  {
+    printf("%s: write splice.in failed\n", s);
+    exit(1);
+  }
+  close(fd);
+
+  // file to pipe, and back to a file.
+  if (pipe(fds) != 0)
+  {
+    printf("%s: pipe() failed\n", s);
+    exit(1);
+  }
+  if (fcntl(fds[1], F_SETPIPE_SZ, 2 * SZ) < 0)
+  {
+    printf("%s: F_SETPIPE_SZ failed\n", s);
+    exit(1);
+  }
+  fd = open("splice.in", O_RDONLY);
+  if ((n = splice(fd, fds[1], 2 * SZ)) != SZ)
+  {
+    printf("%s: splice file to pipe returned %d\n", s, n);
+    exit(1);
+  }
+  if (splice(fd, fds[1], 2 * SZ) != 0)
+  {
+    printf("%s: splice past end of file\n", s);
+    exit(1);
+  }
+  out = open("splice.out", O_CREATE | O_RDWR);
+  if ((n = splice(fds[0], out, 2 * SZ)) != SZ)
+  {
+    printf("%s: splice pipe to file returned %d\n", s, n);
+    exit(1);
+  }
+  close(out);
+  close(fds[0]);
+  close(fds[1]);
+
+  out = open("splice.out", O_RDONLY);
+  memset(buf, 0, SZ);
+  if (read(out, buf, 2 * SZ) != SZ)
+  {
+    printf("%s: splice.out has the wrong size\n", s);
+    exit(1);
+  }
+  for (i = 0; i < SZ; i++)
+  {
+    if (buf[i] != (char)(i * 5))
+    {
+      printf("%s: splice.out wrong at %d\n", s, i);
+      exit(1);
+    }
+  }
+  close(out);
+
+  // sendfile() reads at the offset it is given, and leaves
+  // fd's own offset alone.
+  unlink("splice.out");
+  out = open("splice.out", O_CREATE | O_RDWR);
+  close(fd);
+  fd = open("splice.in", O_RDONLY);
+  if (read(fd, buf, 10) != 10)
+  {
+    printf("%s: read splice.in failed\n", s);
+    exit(1);
+  }
+  if ((n = sendfile(out, fd, 1000, SZ)) != SZ - 1000)
+  {
+    printf("%s: sendfile returned %d\n", s, n);
+    exit(1);
+  }
+  if (read(fd, buf, 1) != 1 || buf[0] != (char)(10 * 5))
+  {
+    printf("%s: sendfile moved the file offset\n", s);
+    exit(1);
+  }
+  if (pipe(fds) != 0 || sendfile(out, fds[0], 0, 10) != -1)
+  {
+    printf("%s: sendfile from a pipe did not fail\n", s);
+    exit(1);
+  }
+  close(fds[0]);
+  close(fds[1]);
+  close(fd);
+  close(out);
+
+  out = open("splice.out", O_RDONLY);
+  if (read(out, buf, 2 * SZ) != SZ - 1000)
+  {
+    printf("%s: splice.out has the wrong size\n", s);
+    exit(1);
+  }
+  for (i = 0; i < SZ - 1000; i++)
+  {
+    if (buf[i] != (char)((i + 1000) * 5))
+    {
+      printf("%s: sendfile data wrong at %d\n", s, i);
+      exit(1);
+    }
+  }
+  close(out);
+  unlink("splice.in");
+  unlink("splice.out");
+}
+
+// lseek() moves a file's offset; pread() and pwrite() use
+// an offset of their own and leave the file's alone.
+void preadtest(char *s)
+{
+  int fd, i;
+  enum
+  {
+    SZ = 3000
+  };
+
+  unlink("pread.tmp");
+  fd = open("pread.tmp", O_CREATE | O_RDWR);
+  if (fd < 0)
+  {
+    printf("%s: create pread.tmp failed\n", s);
+    exit(1);
+  }
+  for (i = 0; i < SZ; i++)
+    buf[i] = i * 7;
+  if (write(fd, buf, SZ) != SZ)
+  {
+    printf("%s: write failed\n", s);
+    exit(1);
+  }
+  if (lseek(fd, 0, SEEK_CUR) != SZ || lseek(fd, -1000, SEEK_END) != SZ - 1000)
+  {
+    printf("%s: lseek returned the wrong offset\n", s);
+    exit(1);
+  }
+  if (read(fd, buf, 1) != 1 || buf[0] != (char)((SZ - 1000) * 7))
+  {
+    printf("%s: read after lseek got the wrong byte\n", s);
+    exit(1);
+  }
+  if (lseek(fd, -1, SEEK_SET) != -1 || lseek(fd, 0, 99) != -1)
+  {
+    printf("%s: bad lseek succeeded\n", s);
+    exit(1);
+  }
+
+  if (pwrite(fd, "hello", 5, 1500) != 5)
+  {
+    printf("%s: pwrite failed\n", s);
+    exit(1);
+  }
+  if (pread(fd, buf, 10, 1498) != 10 || memcmp(buf + 2, "hello", 5) != 0 ||
+      buf[0] != (char)(1498 * 7) || buf[7] != (char)(1507 * 7))
+  {
+    printf("%s: pread did not see pwrite's data\n", s);
+    exit(1);
+  }
+  if (pread(fd, buf, 100, SZ - 10) != 10 || pread(fd, buf, 100, SZ + 10) != 0)
+  {
+    printf("%s: pread near the end of the file\n", s);
+    exit(1);
+  }
+  // the offset is still just past the byte read above.
+  if (read(fd, buf, 1) != 1 || buf[0] != (char)((SZ - 999) * 7))
+  {
+    printf("%s: pread or pwrite moved the offset\n", s);
+    exit(1);
+  }
+  close(fd);
+  unlink("pread.tmp");
+}
+
+// writev() and readv() move several buffers with one call.
+void iovtest(char *s)
+{
+  struct iovec iov[3];
+  char a[10], b[10], c[10];
+  int fd, fds[2], n;
+
+  unlink("iov.tmp");
+  fd = open("iov.tmp", O_CREATE | O_RDWR);
+  if (fd < 0)
+  {
+    printf("%s: create iov.tmp failed\n", s);
+    exit(1);
+  }
+  iov[0].iov_base = "head:";
+  iov[0].iov_len = 5;
+  iov[1].iov_base = "";
+  iov[1].iov_len = 0;
+  iov[2].iov_base = "payload";
+  iov[2].iov_len = 7;
+  if ((n = writev(fd, iov, 3)) != 12)
+  {
+    printf("%s: writev returned %d\n", s, n);
+    exit(1);
+  }
+  if (writev(fd, iov, IOV_MAX + 1) != -1)
+  {
+    printf("%s: writev of too many buffers succeeded\n", s);
+    exit(1);
+  }
+  close(fd);
+
+  fd = open("iov.tmp", O_RDONLY);
+  memset(a, 0, sizeof(a));
+  memset(b, 0, sizeof(b));
+  memset(c, 0, sizeof(c));
+  iov[0].iov_base = a;
+  iov[0].iov_len = 3;
+  iov[1].iov_base = b;
+  iov[1].iov_len = 4;
+  iov[2].iov_base = c;
+  iov[2].iov_len = 10;
+  if ((n = readv(fd, iov, 3)) != 12 || strcmp(a, "hea") != 0 ||
+      strcmp(b, "d:pa") != 0 || strcmp(c, "yload") != 0)
+  {
+    printf("%s: readv returned %d: %s %s %s\n", s, n, a, b, c);
+    exit(1);
+  }
+  close(fd);
+  unlink("iov.tmp");
+
+  if (pipe(fds) != 0)
+  {
+    printf("%s: pipe() failed\n", s);
+    exit(1);
+  }
+  iov[0].iov_base = "ab";
+  iov[0].iov_len = 2;
+  iov[1].iov_base = "cde";
+  iov[1].iov_len = 3;
+  if (writev(fds[1], iov, 2) != 5)
+  {
+    printf("%s: writev to pipe failed\n", s);
+    exit(1);
+  }
+  memset(a, 0, sizeof(a));
+  memset(b, 0, sizeof(b));
+  iov[0].iov_base = a;
+  iov[0].iov_len = 1;
+  iov[1].iov_base = b;
+  iov[1].iov_len = 10;
+  if (readv(fds[0], iov, 2) != 5 || strcmp(a, "a") != 0 || strcmp(b, "bcde") != 0)
+  {
+    printf("%s: readv from pipe got %s %s\n", s, a, b);
+    exit(1);
+  }
+  close(fds[0]);
+  close(fds[1]);
+}
+
+// getdents() returns a directory's entries in batches, with
+// their types and sizes if asked.
+void getdentstest(char *s)
+{
+  struct dirstat ds[4];
+  int fd, i, n, nfile, nsub, ndot;
+
+  if (mkdir("gdd") != 0 || mkdir("gdd/sub") != 0)
+  {
+    printf("%s: mkdir failed\n", s);
+    exit(1);
+  }
+  for (i = 0; i < 5; i++)
+  {
+    char name[] = "gdd/fX";
+    name[5] = '0' + i;
+    fd = open(name, O_CREATE | O_RDWR);
+    if (fd < 0 || write(fd, "0123456789", i) != i)
+    {
+      printf("%s: create %s failed\n", s, name);
+      exit(1);
+    }
+    close(fd);
+  }
+
+  fd = open("gdd", O_RDONLY);
+  nfile = nsub = ndot = 0;
+  while ((n = getdents(fd, ds, 4, GD_STAT)) > 0)
+  {
+    for (i = 0; i < n; i++)
+    {
+      if (strcmp(ds[i].name, ".") == 0 || strcmp(ds[i].name, "..") == 0)
+        ndot++;
+      else if (strcmp(ds[i].name, "sub") == 0 && ds[i].type == T_DIR)
+        nsub++;
+      else if (ds[i].name[0] == 'f' && ds[i].type == T_FILE &&
+               ds[i].size == ds[i].name[1] - '0' && ds[i].nlink == 1)
+        nfile++;
+      else
+      {
+        printf("%s: unexpected entry %s type %d size %d\n",
+               s, ds[i].name, ds[i].type, ds[i].size);
+        exit(1);
+      }
+    }
+  }
+  if (n != 0 || ndot != 2 || nsub != 1 || nfile != 5)
+  {
+    printf("%s: getdents found %d dots, %d dirs, %d files\n", s, ndot, nsub, nfile);
+    exit(1);
+  }
+  close(fd);
+
+  fd = open("gdd/f1", O_RDONLY);
+  if (getdents(fd, ds, 4, 0) != -1)
+  {
+    printf("%s: getdents of a file succeeded\n", s);
+    exit(1);
+  }
+  close(fd);
+
+  for (i = 0; i < 5; i++)
+  {
+    char name[] = "gdd/fX";
+    name[5] = '0' + i;
+    unlink(name);
+  }
+  unlink("gdd/sub");
+  unlink("gdd");
+}
+
+// poll() waits for whichever of several pipes has data,
+// and gives up after its timeout.
+void polltest(char *s)
+{
+  struct pollfd pfd[2];
+  int a[2], b[2], pid, n, t0;
+  char c;
+
+  if (pipe(a) != 0 || pipe(b) != 0)
+  {
+    printf("%s: pipe() failed\n", s);
+    exit(1);
+  }
+  pfd[0].fd = a[0];
+  pfd[0].events = POLLIN;
+  pfd[1].fd = b[0];
+  pfd[1].events = POLLIN;
+
+  t0 = uptime();
+  if ((n = poll(pfd, 2, 3)) != 0)
+  {
+    printf("%s: poll of empty pipes returned %d\n", s, n);
+    exit(1);
+  }
+  if (uptime() - t0 < 3)
+  {
+    printf("%s: poll returned before its timeout\n", s);
+    exit(1);
+  }
+
+  pid = fork();
+  if (pid < 0)
+  {
+    printf("%s: fork() failed\n", s);
+    exit(1);
+  }
+  if (pid == 0)
+  {
+    sleep(2);
+    write(b[1], "x", 1);
+    exit(0);
+  }
+  // wait for the child's byte, on the second pipe.
+  if ((n = poll(pfd, 2, -1)) != 1 || pfd[0].revents != 0 || pfd[1].revents != POLLIN)
+  {
+    printf("%s: poll returned %d, revents %d %d\n", s, n, pfd[0].revents, pfd[1].revents);
+    exit(1);
+  }
+  if (read(b[0], &c, 1) != 1 || c != 'x')
+  {
+    printf("%s: read after poll failed\n", s);
+    exit(1);
+  }
+  wait(0);
+
+  // closing the write end is reported too.
+  close(a[1]);
+  if (poll(pfd, 2, 0) != 1 || pfd[0].revents != POLLHUP)
+  {
+    printf("%s: poll did not report a closed pipe\n", s);
+    exit(1);
+  }
+  pfd[0].fd = b[1];
+  pfd[0].events = POLLOUT;
+  pfd[1].fd = 99;
+  if (poll(pfd, 2, 0) != 2 || pfd[0].revents != POLLOUT || pfd[1].revents != POLLNVAL)
+  {
+    printf("%s: poll of a writable pipe and a bad fd\n", s);
+    exit(1);
+  }
+  close(a[0]);
+  close(b[0]);
+  close(b[1]);
+}
+
+// with O_NONBLOCK, reading an empty pipe and writing a full
+// one return -EAGAIN instead of waiting; a write that only
+// partly fits returns what it wrote.
+void nonblocktest(char *s)
+{
+  int fd, fds[2], n;
+  char b[1024];
+
+  if (pipe(fds) != 0)
+  {
+    printf("%s: pipe() failed\n", s);
+    exit(1);
+  }
+  if (fcntl(fds[0], F_GETFL, 0) != O_RDONLY || fcntl(fds[1], F_GETFL, 0) != O_WRONLY)
+  {
+    printf("%s: F_GETFL of a new pipe\n", s);
+    exit(1);
+  }
+  if (fcntl(fds[0], F_SETFL, O_NONBLOCK) != 0 || fcntl(fds[1], F_SETFL, O_NONBLOCK) != 0 ||
+      fcntl(fds[1], F_GETFL, 0) != (O_WRONLY | O_NONBLOCK))
+  {
+    printf("%s: F_SETFL O_NONBLOCK failed\n", s);
+    exit(1);
+  }
+  if ((n = read(fds[0], b, sizeof(b))) != -EAGAIN)
+  {
+    printf("%s: read of an empty pipe returned %d\n", s, n);
+    exit(1);
+  }
+  if (fcntl(fds[0], F_SETPIPE_SZ, 512) != 512)
+  {
+    printf("%s: F_SETPIPE_SZ failed\n", s);
+    exit(1);
+  }
+  memset(b, 'n', sizeof(b));
+  if ((n = write(fds[1], b, sizeof(b))) != 512)
+  {
+    printf("%s: write to a 512-byte pipe returned %d\n", s, n);
+    exit(1);
+  }
+  if ((n = write(fds[1], b, 1)) != -EAGAIN)
+  {
+    printf("%s: write to a full pipe returned %d\n", s, n);
+    exit(1);
+  }
+  if ((n = read(fds[0], b, sizeof(b))) != 512)
+  {
+    printf("%s: read of a full pipe returned %d\n", s, n);
+    exit(1);
+  }
+  // end-of-file is still 0, not -EAGAIN.
+  close(fds[1]);
+  if ((n = read(fds[0], b, sizeof(b))) != 0)
+  {
+    printf("%s: read of a closed pipe returned %d\n", s, n);
+    exit(1);
+  }
+  close(fds[0]);
+
+  // a directory opens with O_NONBLOCK too, but still only for
+  // reading.
+  if ((fd = open(".", O_RDONLY | O_NONBLOCK)) < 0)
+  {
+    printf("%s: open(., O_RDONLY|O_NONBLOCK) failed\n", s);
+    exit(1);
+  }
+  close(fd);
+  if ((fd = open(".", O_RDWR | O_NONBLOCK)) >= 0)
+  {
+    printf("%s: open(., O_RDWR|O_NONBLOCK) succeeded\n", s);
+    exit(1);
+  }
+}
+
+// splice() from a file into a full non-blocking pipe returns
+// -EAGAIN, and moves only what fits; every byte arrives, in
+// order, as the pipe is drained.
+void nbsplicetest(char *s)
+{
+  int fd, fds[2], i, n, in, got;
+  char b[512];
+  enum
+  {
+    SZ = 3000
+  };
+
+  unlink("nbsplice.in");
+  if ((fd = open("nbsplice.in", O_CREATE | O_RDWR)) < 0)
+  {
+    printf("%s: create nbsplice.in failed\n", s);
+    exit(1);
+  }
+  for (i = 0; i < SZ; i++)
+    buf[i] = i % 251;
+  if (write(fd, buf, SZ) != SZ)
+  {
+    printf("%s: write nbsplice.in failed\n", s);
+    exit(1);
+  }
+  close(fd);
+  if ((fd = open("nbsplice.in", O_RDONLY)) < 0 || pipe(fds) != 0)
+  {
+    printf("%s: open or pipe failed\n", s);
+    exit(1);
+  }
+  if (fcntl(fds[0], F_SETPIPE_SZ, 512) != 512 || fcntl(fds[1], F_SETFL, O_NONBLOCK) != 0)
+  {
+    printf("%s: fcntl failed\n", s);
+    exit(1);
+  }
+  memset(b, 0, sizeof(b));
+  if (write(fds[1], b, sizeof(b)) != sizeof(b))
+  {
+    printf("%s: filling the pipe failed\n", s);
+    exit(1);
+  }
+  if ((n = splice(fd, fds[1], SZ)) != -EAGAIN)
+  {
+    printf("%s: splice into a full pipe returned %d\n", s, n);
+    exit(1);
+  }
+  if (read(fds[0], b, sizeof(b)) != sizeof(b))
+  {
+    printf("%s: draining the pipe failed\n", s);
+    exit(1);
+  }
+
+  for (in = got = 0; got < SZ;)
+  {
+    if (in < SZ)
+    {
+      n = splice(fd, fds[1], SZ - in);
+      if (n <= 0 && n != -EAGAIN)
+      {
+        printf("%s: splice returned %d after %d bytes\n", s, n, in);
+        exit(1);
+      }
+      if (n > 0)
+        in += n;
+    }
+    if ((n = read(fds[0], b, sizeof(b))) <= 0)
+    {
+      printf("%s: read returned %d after %d bytes\n", s, n, got);
+      exit(1);
+    }
+    for (i = 0; i < n; i++)
+    {
+      if ((uchar)b[i] != (got + i) % 251)
+      {
+        printf("%s: wrong byte at %d\n", s, got + i);
+        exit(1);
+      }
+    }
+    got += n;
+  }
+  if (in != SZ || got != SZ || splice(fd, fds[1], 10) != 0)
+  {
+    printf("%s: moved %d and got %d of %d bytes\n", s, in, got, SZ);
+    exit(1);
+  }
+  close(fd);
+  close(fds[0]);
+  close(fds[1]);
+  unlink("nbsplice.in");
+}
+
+// epoll reports the pipes that are ready: a level-triggered
+// one until it is drained, an edge-triggered one once per
+// write. closing a watched pipe stops it being reported.
+void epolltest(char *s)
+{
+  struct epoll_event ev, out[4];
+  struct pollfd pfd;
+  int ep, a[2], b[2], pid, n;
+  char buf[8];
+
+  if ((ep = epoll_create()) < 0)
+  {
+    printf("%s: epoll_create() failed\n", s);
+    exit(1);
+  }
+  if (pipe(a) != 0 || pipe(b) != 0)
+  {
+    printf("%s: pipe() failed\n", s);
+    exit(1);
+  }
+  ev.events = POLLIN;
+  ev.data = 1;
+  if (epoll_ctl(ep, EPOLL_CTL_ADD, a[0], &ev) != 0)
+  {
+    printf("%s: epoll_ctl ADD failed\n", s);
+    exit(1);
+  }
+  ev.events = POLLIN | EPOLLET;
+  ev.data = 2;
+  if (epoll_ctl(ep, EPOLL_CTL_ADD, b[0], &ev) != 0 ||
+      epoll_ctl(ep, EPOLL_CTL_ADD, b[0], &ev) != -1)
+  {
+    printf("%s: epoll_ctl ADD of b failed\n", s);
+    exit(1);
+  }
+  if ((n = epoll_wait(ep, out, 4, 0)) != 0)
+  {
+    printf("%s: epoll_wait with nothing ready returned %d\n", s, n);
+    exit(1);
+  }
+
+  pid = fork();
+  if (pid < 0)
+  {
+    printf("%s: fork() failed\n", s);
+    exit(1);
+  }
+  if (pid == 0)
+  {
+    sleep(2);
+    write(a[1], "ab", 2);
+    write(b[1], "cd", 2);
+    exit(0);
+  }
+  // wait for the child's writes.
+  if (epoll_wait(ep, out, 4, -1) < 1)
   {
-    printf("%s: chdir dir0 failed\n", s);
+    printf("%s: epoll_wait failed\n", s);
     exit(1);
   }
+  wait(0);
 
-  if (chdir("..") < 0)
+  // both are ready; the edge-triggered b only once.
+  if ((n = epoll_wait(ep, out, 4, 0)) < 1 || out[0].data != 1 || out[0].events != POLLIN)
   {
-    printf("%s: chdir .. failed\n", s);
+    printf("%s: level-triggered pipe not reported (%d)\n", s, n);
     exit(1);
   }
-
-  if (unlink("dir0") < 0)
+  if ((n = epoll_wait(ep, out, 4, 0)) != 1 || out[0].data != 1)
   {
-    printf("%s: unlink dir0 failed\n", s);
+    printf("%s: edge-triggered pipe reported twice (%d)\n", s, n);
     exit(1);
   }
-}
-
-void exectest(char *s)
-{
-  int fd, xstatus, pid;
-  char *echoargv[] = {"echo", "OK", 0};
-  char buf[3];
-
-  unlink("echo-ok");
-  pid = fork();
-  if (pid < 0)
+  if (read(a[0], buf, sizeof(buf)) != 2 || (n = epoll_wait(ep, out, 4, 0)) != 0)
   {
-    printf("%s: fork failed\n", s);
+    printf("%s: drained pipe still reported (%d)\n", s, n);
     exit(1);
   }
-  if (pid == 0)
+  // poll() of the epoll descriptor says whether epoll_wait()
+  // would find something.
+  pfd.fd = ep;
+  pfd.events = POLLIN;
+  if (poll(&pfd, 1, 0) != 0)
   {
-    close(1);
-    fd = open("echo-ok", O_CREATE | O_WRONLY);
-    if (fd < 0)
-    {
-      printf("%s: create failed\n", s);
-      exit(1);
-    }
-    if (fd != 1)
-    {
-      printf("%s: wrong fd\n", s);
-      exit(1);
-    }
-    if (exec("echo", echoargv) < 0)
-    {
-      printf("%s: exec echo failed\n", s);
-      exit(1);
-    }
-    // won't get to here
+    printf("%s: poll of an idle epoll descriptor\n", s);
+    exit(1);
   }
-  if (wait(&xstatus) != pid)
+  write(b[1], "e", 1);
+  if (poll(&pfd, 1, 0) != 1 || pfd.revents != POLLIN)
   {
-    printf("%s: wait failed!\n", s);
+    printf("%s: poll of a ready epoll descriptor\n", s);
+    exit(1);
   }
-  if (xstatus != 0)
-    exit(xstatus);
-
-  fd = open("echo-ok", O_RDONLY);
-  if (fd < 0)
+  if ((n = epoll_wait(ep, out, 4, 0)) != 1 || out[0].data != 2)
   {
-    printf("%s: open failed\n", s);
+    printf("%s: edge-triggered pipe not reported after a write (%d)\n", s, n);
     exit(1);
   }
-  if (read(fd, buf, 2) != 2)
+
+  // a hangup is reported; once closed, the pipe is forgotten.
+  close(a[1]);
+  if ((n = epoll_wait(ep, out, 4, 0)) != 1 || out[0].data != 1 || out[0].events != POLLHUP)
   {
-    printf("%s: read failed\n", s);
+    printf("%s: hangup not reported (%d)\n", s, n);
     exit(1);
   }
-  unlink("echo-ok");
-  if (buf[0] == 'O' && buf[1] == 'K')
-    exit(0);
-  else
+  close(a[0]);
+  if ((n = epoll_wait(ep, out, 4, 0)) != 0 ||
+      epoll_ctl(ep, EPOLL_CTL_DEL, b[0], 0) != 0 ||
+      epoll_ctl(ep, EPOLL_CTL_DEL, b[0], 0) != -1)
   {
-    printf("%s: wrong output\n", s);
+    printf("%s: epoll_ctl DEL failed (%d)\n", s, n);
     exit(1);
   }
+  close(b[0]);
+  close(b[1]);
+  close(ep);
 }
 
-// simple fork and pipe read/write
-
-void pipe1(char *s)
+// the console's input mode can be read and set with ioctl();
+// other files have no ioctl()s.
+void ioctltest(char *s)
 {
-  int fds[2], pid, xstatus;
-  int seq, i, n, cc, total;
-  enum
-  {
-    N = 5,
-    SZ = 1033
-  };
+  int fd, fds[2], mode;
 
-  if (pipe(fds) != 0)
+  if ((fd = open("console", O_RDWR)) < 0)
   {
-    printf("%s: pipe() failed\n", s);
+    printf("%s: cannot open console\n", s);
     exit(1);
   }
-  pid = fork();
-  seq = 0;
-  if (pid == 0)
+  mode = ioctl(fd, CIOCGMODE, 0);
+  if (mode != CONS_COOKED && mode != CONS_RAW)
   {
-    close(fds[0]);
-    for (n = 0; n < N; n++)
-    {
-      for (i = 0; i < SZ; i++)
-        buf[i] = seq++;
-      if (write(fds[1], buf, SZ) != SZ)
-      {
-        printf("%s: pipe1 oops 1\n", s);
-        exit(1);
-      }
-    }
-    exit(0);
+    printf("%s: CIOCGMODE returned %d\n", s, mode);
+    exit(1);
   }
-  else if (pid > 0)
+  if (ioctl(fd, CIOCSMODE, CONS_RAW) != 0 || ioctl(fd, CIOCGMODE, 0) != CONS_RAW ||
+      ioctl(fd, CIOCSMODE, CONS_COOKED) != 0 || ioctl(fd, CIOCGMODE, 0) != CONS_COOKED)
   {
-    close(fds[1]);
-    total = 0;
-    cc = 1;
-    while ((n = read(fds[0], buf, cc)) > 0)
-    {
-      for (i = 0; i < n; i++)
-      {
-        if ((buf[i] & 0xff) != (seq++ & 0xff))
-        {
-          printf("%s: pipe1 oops 2\n", s);
-          return;
-        }
-      }
-      total += n;
-      cc = cc * 2;
-      if (cc > sizeof(buf))
-        cc = sizeof(buf);
-    }
-    if (total != N * SZ)
-    {
-      printf("%s: pipe1 oops 3 total %d\n", s, total);
-      exit(1);
-    }
-    close(fds[0]);
-    wait(&xstatus);
-    exit(xstatus);
+    printf("%s: CIOCSMODE failed\n", s);
+    exit(1);
   }
-  else
+  if (ioctl(fd, CIOCSMODE, 99) != -1 || ioctl(fd, 99, 0) != -1)
   {
-    printf("%s: fork() failed\n", s);
+    printf("%s: bad ioctl succeeded\n", s);
+    exit(1);
+  }
+  ioctl(fd, CIOCSMODE, mode);
+  close(fd);
+
+  if (pipe(fds) != 0)
+  {
+    printf("%s: pipe() failed\n", s);
+    exit(1);
+  }
+  if (ioctl(fds[0], CIOCGMODE, 0) != -1)
+  {
+    printf("%s: ioctl on a pipe succeeded\n", s);
     exit(1);
   }
+  close(fds[0]);
+  close(fds[1]);
 }
 
 // test if child is killed (status = -1)
@@ -2275,6 +3475,80 @@ void iref(char *s)
   chdir("/");
 }
 
+// more inodes in use at once than the inode table once held.
+void manyinodes(char *s)
+{
+  enum
+  {
+    NCHILD = 7,
+    NFD = 9
+  };
+  int ready[2], go[2];
+  int c, i, pid, xstatus;
+  char name[8], x;
+
+  if (pipe(ready) < 0 || pipe(go) < 0)
+  {
+    printf("%s: pipe failed\n", s);
+    exit(1);
+  }
+  for (c = 0; c < NCHILD; c++)
+  {
+    pid = fork();
+    if (pid < 0)
+    {
+      printf("%s: fork failed\n", s);
+      exit(1);
+    }
+    if (pid == 0)
+    {
+      close(ready[0]);
+      close(go[1]);
+      name[0] = 'm';
+      name[1] = 'i';
+      name[2] = '0' + c;
+      name[4] = 0;
+      for (i = 0; i < NFD; i++)
+      {
+        name[3] = 'a' + i;
+        if (open(name, O_CREATE | O_RDWR) < 0)
+        {
+          printf("%s: create %s failed\n", s, name);
+          write(ready[1], "x", 1);
+          exit(1);
+        }
+      }
+      write(ready[1], "x", 1);
+      // hold them all open until the parent says go.
+      read(go[0], &x, 1);
+      for (i = 0; i < NFD; i++)
+      {
+        name[3] = 'a' + i;
+        unlink(name);
+      }
+      exit(0);
+    }
+  }
+  close(go[0]);
+  for (c = 0; c < NCHILD; c++)
+  {
+    if (read(ready[0], &x, 1) != 1)
+    {
+      printf("%s: child died\n", s);
+      exit(1);
+    }
+  }
+  close(go[1]);
+  for (c = 0; c < NCHILD; c++)
+  {
+    wait(&xstatus);
+    if (xstatus != 0)
+      exit(1);
+  }
+  close(ready[0]);
+  close(ready[1]);
+}
+
 // test that fork fails gracefully
 // the forktest binary also does this, but it runs out of proc entries first.
 // inside the bigger usertests binary, we run out of memory first.
@@ -2981,11 +4255,27 @@ struct test
     {iputtest, "iput"},
     {opentest, "opentest"},
     {writetest, "writetest"},
+    {fsynctest, "fsynctest"},
+    {fmaptest, "fmaptest"},
+    {inlinetest, "inlinetest"},
     {writebig, "writebig"},
+    {writehuge, "writehuge"},
     {createtest, "createtest"},
     {dirtest, "dirtest"},
+    {dirindex, "dirindex"},
+    {dcachetest, "dcachetest"},
+    {getdentstest, "getdentstest"},
     {exectest, "exectest"},
     {pipe1, "pipe1"},
+    {pipesize, "pipesize"},
+    {splicetest, "splicetest"},
+    {preadtest, "preadtest"},
+    {iovtest, "iovtest"},
+    {polltest, "polltest"},
+    {nonblocktest, "nonblocktest"},
+    {nbsplicetest, "nbsplicetest"},
+    {epolltest, "epolltest"},
+    {ioctltest, "ioctltest"},
     {killstatus, "killstatus"},
     {preempt, "preempt"},
     {exitwait, "exitwait"},
@@ -3009,6 +4299,7 @@ struct test
     {rmdot, "rmdot"},
     {dirfile, "dirfile"},
     {iref, "iref"},
+    {manyinodes, "manyinodes"},
     {forktest, "forktest"},
     {sbrkbasic, "sbrkbasic"},
     {sbrkmuch, "sbrkmuch"},
@@ -3347,6 +4638,168 @@ void outofinodes(char *s)
   }
 }
 
+// unlinking a big file hands it to itruncd, which frees its
+// blocks in the background. fill the disk with big files,
+// unlink them all, and write them again: the second round
+// only fits once itruncd has given the space back.
+void bgtrunc(char *s)
+{
+  enum
+  {
+    NB = NDIRECT + 4, // blocks per file
+    NF = 200          // most files
+  };
+  char name[8];
+  int i, j, n, fd, tries;
+
+  name[0] = 'b';
+  name[1] = 't';
+  name[4] = '\0';
+  memset(buf, 0, BSIZE);
+
+  for (n = 0; n < NF; n++)
+  {
+    name[2] = '0' + n / 64;
+    name[3] = '0' + n % 64;
+    fd = open(name, O_CREATE | O_RDWR | (n % 2 ? O_BLOCKMAP : 0));
+    if (fd < 0)
+      break;
+    for (j = 0; j < NB; j++)
+    {
+      if (write(fd, buf, BSIZE) != BSIZE)
+        break;
+    }
+    close(fd);
+    if (j < NB)
+    {
+      // the disk is full.
+      unlink(name);
+      break;
+    }
+  }
+  for (i = 0; i < n; i++)
+  {
+    name[2] = '0' + i / 64;
+    name[3] = '0' + i % 64;
+    if (unlink(name) < 0)
+    {
+      printf("%s: unlink %s failed\n", s, name);
+      exit(1);
+    }
+  }
+
+  tries = 0;
+  for (i = 0; i < n; i++)
+  {
+    name[2] = '0' + i / 64;
+    name[3] = '0' + i % 64;
+    while ((fd = open(name, O_CREATE | O_RDWR | (i % 2 ? O_BLOCKMAP : 0))) < 0)
+    {
+      // itruncd has not freed the old inodes yet.
+      if (++tries > 50)
+      {
+        printf("%s: create %s failed\n", s, name);
+        exit(1);
+      }
+      sleep(10);
+    }
+    for (j = 0; j < NB;)
+    {
+      if (write(fd, buf, BSIZE) == BSIZE)
+      {
+        j++;
+        continue;
+      }
+      // itruncd is not done yet.
+      if (++tries > 50)
+      {
+        printf("%s: %d files of %d blocks fit once, then only %d\n", s, n, NB, i);
+        exit(1);
+      }
+      sleep(10);
+    }
+    close(fd);
+  }
+  for (i = 0; i < n; i++)
+  {
+    name[2] = '0' + i / 64;
+    name[3] = '0' + i % 64;
+    unlink(name);
+  }
+}
+
+// O_TRUNC frees a big file a few blocks at a time, in
+// transactions of their own (itruncop()). truncate a big file
+// of each format with the rest of the disk full, and check
+// that its blocks can be used again.
+void truncbig(char *s)
+{
+  enum
+  {
+    N = 300,     // blocks in the file
+    NFILL = 4000 // most blocks to fill the disk with
+  };
+  int fmt, i, fd, nfill;
+  struct stat st;
+
+  for (fmt = 0; fmt < 2; fmt++)
+  {
+    fd = open("truncbig", O_CREATE | O_RDWR | (fmt ? O_BLOCKMAP : 0));
+    if (fd < 0)
+    {
+      printf("%s: create truncbig failed\n", s);
+      exit(1);
+    }
+    for (i = 0; i < N; i++)
+    {
+      if (write(fd, buf, BSIZE) != BSIZE)
+      {
+        printf("%s: write truncbig failed at block %d\n", s, i);
+        exit(1);
+      }
+    }
+    close(fd);
+
+    // use up the rest of the disk.
+    fd = open("truncfill", O_CREATE | O_RDWR);
+    if (fd < 0)
+    {
+      printf("%s: create truncfill failed\n", s);
+      exit(1);
+    }
+    for (nfill = 0; nfill < NFILL && write(fd, buf, BSIZE) == BSIZE; nfill++)
+      ;
+    close(fd);
+
+    fd = open("truncbig", O_RDWR | O_TRUNC);
+    if (fd < 0)
+    {
+      printf("%s: open truncbig with O_TRUNC failed\n", s);
+      exit(1);
+    }
+    if (fstat(fd, &st) < 0 || st.size != 0)
+    {
+      printf("%s: size %d after O_TRUNC\n", s, (int)st.size);
+      exit(1);
+    }
+    for (i = 0; i < N; i++)
+    {
+      if (write(fd, buf, BSIZE) != BSIZE)
+      {
+        printf("%s: only %d of %d blocks came back (format %d)\n", s, i, N, fmt);
+        exit(1);
+      }
+    }
+    close(fd);
+
+    // empty both, so that unlink() frees them now.
+    close(open("truncfill", O_RDWR | O_TRUNC));
+    close(open("truncbig", O_RDWR | O_TRUNC));
+    unlink("truncfill");
+    unlink("truncbig");
+  }
+}
+
 struct test slowtests[] = {
     {bigdir, "bigdir"},
     {manywrites, "manywrites"},
@@ -3354,6 +4807,8 @@ struct test slowtests[] = {
     {execout, "execout"},
     {diskfull, "diskfull"},
     {outofinodes, "outofinodes"},
+    {bgtrunc, "bgtrunc"},
+    {truncbig, "truncbig"},
 
     {0, 0},
 };
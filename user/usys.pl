@@ -36,3 +36,19 @@ entry("getpid");
 entry("sbrk");
 entry("sleep");
 entry("uptime");
+entry("fsync");
+entry("fmap");
+entry("fcntl");
+entry("splice");
+entry("sendfile");
+entry("lseek");
+entry("pread");
+entry("pwrite");
+entry("readv");
+entry("writev");
+entry("getdents");
+entry("poll");
+entry("epoll_create");
+entry("epoll_ctl");
+entry("epoll_wait");
+entry("ioctl");